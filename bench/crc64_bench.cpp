@@ -0,0 +1,47 @@
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <vector>
+
+#include "crc64.h"
+
+typedef uint64_t (*Crc64Func)(uint64_t crc, const unsigned char* s, uint64_t l);
+
+// Throughput of each crc64 implementation over a buffer the size of a large .obj, best of a few
+// runs. Usage: crc64_bench [megabytes]
+int main(int argc, char* argv[])
+{
+	size_t size = (size_t)(argc > 1 ? atoi(argv[1]) : 256) << 20;
+	std::vector<unsigned char> buffer(size);
+	for (size_t i = 0; i < size; i++) buffer[i] = (unsigned char)(i * 131 + (i >> 9));
+
+	struct
+	{
+		const char* name;
+		Crc64Func func;
+	} impls[] = {
+		{ "bytewise", crc64_bytewise },
+		{ "slice8", crc64_slice8 },
+		{ "slice16", crc64_slice16 },
+		{ "clmul", crc64_clmul },
+	};
+	for (const auto& impl : impls)
+	{
+		if (impl.func == crc64_clmul && !crc64_has_clmul())
+		{
+			printf("%-9s not supported\n", impl.name);
+			continue;
+		}
+		double best = 0.0;
+		uint64_t crc = 0;
+		for (int run = 0; run < 3; run++)
+		{
+			auto start = std::chrono::steady_clock::now();
+			crc = impl.func(0, buffer.data(), buffer.size());
+			double seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+			if (run == 0 || seconds < best) best = seconds;
+		}
+		printf("%-9s %7.2f GB/s  %016llx\n", impl.name, (double)size / best / 1e9, (unsigned long long)crc);
+	}
+	return 0;
+}
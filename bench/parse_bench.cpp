@@ -0,0 +1,142 @@
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <random>
+#include <string>
+#include <vector>
+
+#define TINYOBJLOADER_IMPLEMENTATION
+#include "tiny_obj_loader.h"
+#include "parse_number.h"
+
+// Number tokens parsed per second by tinyobj's parsers and by parse_number.h, on text like the
+// "v" and "f" lines of an exported .obj. Also counts the floats that are not correctly rounded.
+// Usage: parse_bench [millions of tokens]
+
+static double Seconds(std::chrono::steady_clock::time_point start)
+{
+	return std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+}
+
+static void Report(const char* name, double seconds, size_t num_tokens, size_t num_bytes)
+{
+	printf("%-26s %7.3f s %8.1f M tokens/s %8.1f MB/s\n", name, seconds, num_tokens / seconds / 1e6, num_bytes / seconds / 1e6);
+}
+
+int main(int argc, char* argv[])
+{
+	size_t num_tokens = (size_t)(argc > 1 ? atof(argv[1]) : 10.0) * 1000000;
+	if (num_tokens == 0) num_tokens = 1;
+
+	// Coordinates as exporters print them, mostly fixed point with a few in exponent form.
+	std::mt19937_64 rng(1);
+	std::uniform_real_distribution<double> coordinate(-1000.0, 1000.0);
+	std::string floats;
+	std::vector<float> expected(num_tokens);
+	char token[64];
+	for (size_t i = 0; i < num_tokens; i++)
+	{
+		double value = coordinate(rng);
+		if (i % 16 == 0)
+		{
+			snprintf(token, sizeof(token), "%.9g ", value * 1e-7);
+		}
+		else
+		{
+			snprintf(token, sizeof(token), "%.6f ", value);
+		}
+		floats += token;
+		expected[i] = strtof(token, nullptr);
+	}
+
+	// Face corners of a large mesh, "v/vt/vn".
+	std::string triples;
+	for (size_t i = 0; i < num_tokens; i++)
+	{
+		int v = 1 + (int)(rng() % 10000000);
+		snprintf(token, sizeof(token), "%d/%d/%d ", v, v, v);
+		triples += token;
+	}
+
+	// Room for the 8-byte reads past the end.
+	floats.append(16, '\0');
+	triples.append(16, '\0');
+	size_t floats_size = floats.size() - 16;
+	size_t triples_size = triples.size() - 16;
+	printf("%zu floats (%zu bytes), %zu index triples (%zu bytes)\n", num_tokens, floats_size, num_tokens, triples_size);
+
+	std::vector<float> parsed(num_tokens);
+	auto start = std::chrono::steady_clock::now();
+	const char* p = floats.c_str();
+	for (size_t i = 0; i < num_tokens; i++)
+	{
+		parsed[i] = tinyobj::parseReal(&p);
+	}
+	double tinyobj_time = Seconds(start);
+	size_t tinyobj_misrounded = 0;
+	for (size_t i = 0; i < num_tokens; i++)
+	{
+		if (parsed[i] != expected[i]) tinyobj_misrounded++;
+	}
+
+	start = std::chrono::steady_clock::now();
+	const char* end = floats.c_str() + floats_size;
+	const char* limit = floats.c_str() + floats.size();
+	p = floats.c_str();
+	for (size_t i = 0; i < num_tokens; i++)
+	{
+		const char* token_end = p;
+		while (token_end < end && *token_end != ' ') token_end++;
+		ParseDecimal(p, token_end, limit, &parsed[i]);
+		p = token_end + 1;
+	}
+	double decimal_time = Seconds(start);
+	size_t decimal_misrounded = 0;
+	for (size_t i = 0; i < num_tokens; i++)
+	{
+		if (parsed[i] != expected[i]) decimal_misrounded++;
+	}
+
+	Report("tinyobj::parseReal", tinyobj_time, num_tokens, floats_size);
+	Report("ParseDecimal<float>", decimal_time, num_tokens, floats_size);
+	printf("not correctly rounded: tinyobj %zu, ParseDecimal %zu\n", tinyobj_misrounded, decimal_misrounded);
+
+	int64_t tinyobj_sum = 0;
+	start = std::chrono::steady_clock::now();
+	p = triples.c_str();
+	for (size_t i = 0; i < num_tokens; i++)
+	{
+		tinyobj::vertex_index_t vi = tinyobj::parseRawTriple(&p);
+		tinyobj_sum += vi.v_idx + vi.vt_idx + vi.vn_idx;
+		p++;
+	}
+	double tinyobj_triple_time = Seconds(start);
+
+	int64_t digits_sum = 0;
+	start = std::chrono::steady_clock::now();
+	end = triples.c_str() + triples_size;
+	limit = triples.c_str() + triples.size();
+	p = triples.c_str();
+	for (size_t i = 0; i < num_tokens; i++)
+	{
+		for (int k = 0; k < 3; k++)
+		{
+			uint64_t value = 0;
+			int num_digits = 0;
+			p = AccumulateDigits(p, end, limit, &value, &num_digits);
+			digits_sum += (int64_t)value;
+			p++;
+		}
+	}
+	double digits_time = Seconds(start);
+
+	Report("tinyobj::parseRawTriple", tinyobj_triple_time, num_tokens, triples_size);
+	Report("AccumulateDigits x 3", digits_time, num_tokens, triples_size);
+	if (tinyobj_sum != digits_sum || decimal_misrounded != 0)
+	{
+		printf("parse_number.h results are wrong\n");
+		return 1;
+	}
+	return 0;
+}
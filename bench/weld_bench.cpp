@@ -0,0 +1,164 @@
+#include <algorithm>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <random>
+#include <unordered_map>
+#include <vector>
+
+#include "crc64.h"
+#include "flat_index_map.h"
+#include "tiny_obj_loader.h"
+#include "sort_weld.h"
+
+// Corners welded per second by the exact weld engines, on a grid mesh laid out as exported:
+// faces row by row, one vertex per grid point with its normal, and texture coordinates split at
+// a seam every 64 columns. Usage: weld_bench [grid side] [shuffle]
+// 'shuffle' scatters the vertex numbers, which is the worst case for the sort weld.
+
+static double Seconds(std::chrono::steady_clock::time_point start)
+{
+	return std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+}
+
+// How main.cpp welded before: the attributes of a corner hashed bytewise with crc64, and the
+// hash taken as the vertex.
+static size_t WeldCrc64(const tinyobj::attrib_t& attrib, const std::vector<tinyobj::index_t>& indices, int* corner_vertices)
+{
+	struct Attributes
+	{
+		float pos[3];
+		float norm[3];
+		float color[3];
+		float uv[2];
+	};
+
+	std::unordered_map<uint64_t, size_t> ind_map;
+	size_t num_vertices = 0;
+	for (size_t i = 0; i < indices.size(); i++)
+	{
+		const tinyobj::index_t& index = indices[i];
+		Attributes att;
+		memset(&att, 0, sizeof(att));
+		memcpy(att.pos, &attrib.vertices[3 * (size_t)index.vertex_index], sizeof(att.pos));
+		memcpy(att.norm, &attrib.normals[3 * (size_t)index.normal_index], sizeof(att.norm));
+		att.uv[0] = attrib.texcoords[2 * (size_t)index.texcoord_index];
+		att.uv[1] = 1.0f - attrib.texcoords[2 * (size_t)index.texcoord_index + 1];
+
+		uint64_t hash = crc64_bytewise(0, (const unsigned char*)&att, sizeof(Attributes));
+		auto iter = ind_map.find(hash);
+		if (iter == ind_map.end())
+		{
+			iter = ind_map.emplace(hash, num_vertices++).first;
+		}
+		corner_vertices[i] = (int)iter->second;
+	}
+	return num_vertices;
+}
+
+static size_t WeldFlatIndexMap(const std::vector<tinyobj::index_t>& indices, std::vector<tinyobj::index_t>* vertices, int* corner_vertices)
+{
+	FlatIndexMap<tinyobj::index_t> index_map(indices.size() / 3);
+	for (size_t i = 0; i < indices.size(); i++)
+	{
+		bool inserted;
+		corner_vertices[i] = index_map.Insert(indices[i], &inserted);
+		if (inserted) vertices->push_back(indices[i]);
+	}
+	return vertices->size();
+}
+
+int main(int argc, char* argv[])
+{
+	int side = argc > 1 ? atoi(argv[1]) : 1000;
+	bool shuffle = argc > 2 && atoi(argv[2]) != 0;
+	if (side < 1) side = 1;
+
+	// Grid points, and one more texture coordinate per row at each seam.
+	int row_points = side + 1;
+	int row_texcoords = row_points + side / 64;
+	size_t num_points = (size_t)row_points * row_points;
+	tinyobj::attrib_t attrib;
+	for (int y = 0; y < row_points; y++)
+	{
+		for (int x = 0; x < row_points; x++)
+		{
+			attrib.vertices.insert(attrib.vertices.end(), { (float)x, (float)y, 0.0f });
+			attrib.normals.insert(attrib.normals.end(), { 0.0f, 0.0f, 1.0f });
+		}
+		for (int t = 0; t < row_texcoords; t++)
+		{
+			attrib.texcoords.insert(attrib.texcoords.end(), { (float)t / side, (float)y / side });
+		}
+	}
+
+	std::vector<int> point_numbers(num_points);
+	for (size_t p = 0; p < num_points; p++) point_numbers[p] = (int)p;
+	if (shuffle)
+	{
+		std::mt19937 rng(1);
+		std::shuffle(point_numbers.begin(), point_numbers.end(), rng);
+	}
+
+	std::vector<tinyobj::index_t> indices;
+	indices.reserve((size_t)side * side * 6);
+	for (int y = 0; y < side; y++)
+	{
+		for (int x = 0; x < side; x++)
+		{
+			// The quad's texture coordinates on the far side of a seam are the duplicated ones.
+			int t0 = x + x / 64;
+			int t1 = (x + 1) % 64 == 0 ? t0 + 1 : x + 1 + (x + 1) / 64;
+			const int corners[6][2] = { { 0, 0 }, { 1, 0 }, { 1, 1 }, { 0, 0 }, { 1, 1 }, { 0, 1 } };
+			for (const int* c : corners)
+			{
+				int px = x + c[0];
+				int py = y + c[1];
+				tinyobj::index_t index;
+				index.vertex_index = point_numbers[(size_t)py * row_points + px];
+				index.normal_index = index.vertex_index;
+				index.texcoord_index = (py * row_texcoords) + (c[0] ? t1 : t0);
+				indices.push_back(index);
+			}
+		}
+	}
+	size_t num_corners = indices.size();
+	size_t num_faces = num_corners / 3;
+	std::vector<int> faces(num_faces);
+	for (size_t f = 0; f < num_faces; f++) faces[f] = (int)f;
+
+	printf("%d x %d grid%s: %zu faces, %zu corners\n", side, side, shuffle ? ", shuffled" : "", num_faces, num_corners);
+
+	std::vector<int> crc64_corners(num_corners);
+	std::vector<int> hash_corners(num_corners);
+	std::vector<int> sort_corners(num_corners);
+	std::vector<tinyobj::index_t> hash_vertices;
+	std::vector<tinyobj::index_t> sort_vertices;
+
+	auto start = std::chrono::steady_clock::now();
+	size_t crc64_count = WeldCrc64(attrib, indices, crc64_corners.data());
+	double crc64_time = Seconds(start);
+
+	start = std::chrono::steady_clock::now();
+	size_t hash_count = WeldFlatIndexMap(indices, &hash_vertices, hash_corners.data());
+	double hash_time = Seconds(start);
+
+	start = std::chrono::steady_clock::now();
+	SortWeld(indices.data(), faces.data(), num_faces, &sort_vertices, sort_corners.data());
+	double sort_time = Seconds(start);
+
+	printf("crc64 + unordered_map %8.3f s %8.1f M corners/s  %zu vertices\n", crc64_time, num_corners / crc64_time / 1e6, crc64_count);
+	printf("FlatIndexMap          %8.3f s %8.1f M corners/s  %zu vertices\n", hash_time, num_corners / hash_time / 1e6, hash_count);
+	printf("SortWeld              %8.3f s %8.1f M corners/s  %zu vertices\n", sort_time, num_corners / sort_time / 1e6, sort_vertices.size());
+
+	// The two exact engines have to agree on the vertices and their order.
+	bool same = hash_corners == sort_corners && hash_vertices.size() == sort_vertices.size() &&
+		memcmp(hash_vertices.data(), sort_vertices.data(), hash_vertices.size() * sizeof(tinyobj::index_t)) == 0;
+	if (!same)
+	{
+		printf("FlatIndexMap and SortWeld results differ\n");
+		return 1;
+	}
+	return 0;
+}
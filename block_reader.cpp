@@ -0,0 +1,255 @@
+#include <algorithm>
+#include <cstring>
+
+#include "block_reader.h"
+
+#ifdef OBJ2GLB_WITH_ZLIB
+#include <zlib.h>
+#endif
+
+#ifdef OBJ2GLB_WITH_ZSTD
+#include <zstd.h>
+#endif
+
+// Input read from a FILE*, starting with the bytes already read to detect the compression.
+class FileInput
+{
+public:
+	FileInput(FILE* file, bool owned, const char* prefix, size_t prefix_size, size_t buffer_size)
+		: m_file(file), m_owned(owned), m_buffer(std::max(buffer_size, prefix_size))
+	{
+		memcpy(m_buffer.data(), prefix, prefix_size);
+		m_size = prefix_size;
+	}
+
+	~FileInput()
+	{
+		if (m_owned) fclose(m_file);
+	}
+
+	// Refills the buffer once all of it has been consumed. Returns false at the end of the file.
+	bool Fill()
+	{
+		if (m_pos < m_size) return true;
+		m_size = fread(m_buffer.data(), 1, m_buffer.size(), m_file);
+		m_pos = 0;
+		return m_size > 0;
+	}
+
+	FILE* file() const { return m_file; }
+	bool error() const { return ferror(m_file) != 0; }
+
+	const char* data() const { return m_buffer.data() + m_pos; }
+	size_t size() const { return m_size - m_pos; }
+	void Consume(size_t count) { m_pos += count; }
+
+private:
+	FILE* m_file;
+	bool m_owned;
+	std::vector<char> m_buffer;
+	size_t m_pos = 0;
+	size_t m_size = 0;
+};
+
+class PlainReader : public BlockReader
+{
+public:
+	PlainReader(FILE* file, bool owned, const char* prefix, size_t prefix_size)
+		: m_input(file, owned, prefix, prefix_size, 0) {}
+
+	virtual size_t Read(char* data, size_t size)
+	{
+		size_t count = std::min(size, m_input.size());
+		memcpy(data, m_input.data(), count);
+		m_input.Consume(count);
+		if (count < size)
+		{
+			// Past the prefix, read straight into the caller's buffer.
+			FILE* file = m_input.file();
+			size_t ret = fread(data + count, 1, size - count, file);
+			if (ret < size - count && ferror(file)) Fail("Read error");
+			count += ret;
+		}
+		return count;
+	}
+
+private:
+	FileInput m_input;
+};
+
+#ifdef OBJ2GLB_WITH_ZLIB
+
+class GzipReader : public BlockReader
+{
+public:
+	GzipReader(FILE* file, bool owned, const char* prefix, size_t prefix_size)
+		: m_input(file, owned, prefix, prefix_size, 1 << 18)
+	{
+		memset(&m_stream, 0, sizeof(m_stream));
+		// 16 + MAX_WBITS: gzip wrapper
+		if (inflateInit2(&m_stream, 16 + MAX_WBITS) != Z_OK) Fail("Cannot initialize zlib");
+	}
+
+	virtual ~GzipReader()
+	{
+		inflateEnd(&m_stream);
+	}
+
+	virtual size_t Read(char* data, size_t size)
+	{
+		size_t count = 0;
+		while (count < size && !failed())
+		{
+			if (!m_input.Fill())
+			{
+				if (m_input.error()) Fail("Read error");
+				else if (m_in_member) Fail("Truncated gzip stream");
+				break;
+			}
+			if (!m_in_member)
+			{
+				// Concatenated gzip members decode as one stream, like gzip -d does.
+				inflateReset(&m_stream);
+				m_in_member = true;
+			}
+
+			// avail_in and avail_out are unsigned ints.
+			unsigned int avail_in = (unsigned int)std::min(m_input.size(), (size_t)1 << 30);
+			unsigned int avail_out = (unsigned int)std::min(size - count, (size_t)1 << 30);
+			m_stream.next_in = (Bytef*)m_input.data();
+			m_stream.avail_in = avail_in;
+			m_stream.next_out = (Bytef*)(data + count);
+			m_stream.avail_out = avail_out;
+			int ret = inflate(&m_stream, Z_NO_FLUSH);
+			m_input.Consume(avail_in - m_stream.avail_in);
+			count += avail_out - m_stream.avail_out;
+			if (ret == Z_STREAM_END)
+			{
+				m_in_member = false;
+			}
+			else if (ret != Z_OK && ret != Z_BUF_ERROR)
+			{
+				Fail(m_stream.msg ? m_stream.msg : "Corrupt gzip stream");
+			}
+		}
+		return count;
+	}
+
+private:
+	FileInput m_input;
+	z_stream m_stream;
+	bool m_in_member = false;
+};
+
+#endif
+
+#ifdef OBJ2GLB_WITH_ZSTD
+
+class ZstdReader : public BlockReader
+{
+public:
+	ZstdReader(FILE* file, bool owned, const char* prefix, size_t prefix_size)
+		: m_input(file, owned, prefix, prefix_size, ZSTD_DStreamInSize())
+	{
+		m_stream = ZSTD_createDStream();
+		ZSTD_initDStream(m_stream);
+	}
+
+	virtual ~ZstdReader()
+	{
+		ZSTD_freeDStream(m_stream);
+	}
+
+	virtual size_t Read(char* data, size_t size)
+	{
+		ZSTD_outBuffer output = { data, size, 0 };
+		while (output.pos < output.size && !failed())
+		{
+			if (!m_input.Fill())
+			{
+				if (m_input.error()) Fail("Read error");
+				else if (m_in_frame) Fail("Truncated zstd stream");
+				break;
+			}
+			ZSTD_inBuffer input = { m_input.data(), m_input.size(), 0 };
+			size_t ret = ZSTD_decompressStream(m_stream, &output, &input);
+			m_input.Consume(input.pos);
+			if (ZSTD_isError(ret))
+			{
+				Fail(ZSTD_getErrorName(ret));
+				break;
+			}
+			m_in_frame = ret != 0;
+		}
+		return output.pos;
+	}
+
+private:
+	FileInput m_input;
+	ZSTD_DStream* m_stream;
+	bool m_in_frame = false;
+};
+
+#endif
+
+static Compression CompressionFromMagic(const unsigned char* magic, size_t size)
+{
+	if (size >= 2 && magic[0] == 0x1f && magic[1] == 0x8b) return Compression::Gzip;
+	if (size >= 4 && magic[0] == 0x28 && magic[1] == 0xb5 && magic[2] == 0x2f && magic[3] == 0xfd) return Compression::Zstd;
+	return Compression::None;
+}
+
+bool DetectCompression(const char* filename, Compression* compression)
+{
+	FILE* file = fopen(filename, "rb");
+	if (file == nullptr) return false;
+	unsigned char magic[4];
+	size_t size = fread(magic, 1, 4, file);
+	fclose(file);
+	*compression = CompressionFromMagic(magic, size);
+	return true;
+}
+
+static std::unique_ptr<BlockReader> CreateReader(FILE* file, bool owned, const char* name, std::string* err)
+{
+	char magic[4];
+	size_t size = fread(magic, 1, 4, file);
+	switch (CompressionFromMagic((const unsigned char*)magic, size))
+	{
+	case Compression::Gzip:
+#ifdef OBJ2GLB_WITH_ZLIB
+		return std::unique_ptr<BlockReader>(new GzipReader(file, owned, magic, size));
+#else
+		if (err) (*err) = std::string("Cannot read [") + name + "]: built without gzip support\n";
+		break;
+#endif
+	case Compression::Zstd:
+#ifdef OBJ2GLB_WITH_ZSTD
+		return std::unique_ptr<BlockReader>(new ZstdReader(file, owned, magic, size));
+#else
+		if (err) (*err) = std::string("Cannot read [") + name + "]: built without zstd support\n";
+		break;
+#endif
+	default:
+		return std::unique_ptr<BlockReader>(new PlainReader(file, owned, magic, size));
+	}
+
+	if (owned) fclose(file);
+	return nullptr;
+}
+
+std::unique_ptr<BlockReader> OpenBlockReader(const char* filename, std::string* err)
+{
+	FILE* file = fopen(filename, "rb");
+	if (file == nullptr)
+	{
+		if (err) (*err) = std::string("Cannot open file [") + filename + "]\n";
+		return nullptr;
+	}
+	return CreateReader(file, true, filename, err);
+}
+
+std::unique_ptr<BlockReader> OpenBlockReader(FILE* file, const char* name, std::string* err)
+{
+	return CreateReader(file, false, name, err);
+}
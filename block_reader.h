@@ -0,0 +1,78 @@
+#ifndef _block_reader_h
+#define _block_reader_h
+
+#include <cstddef>
+#include <cstdio>
+#include <memory>
+#include <streambuf>
+#include <string>
+#include <vector>
+
+enum class Compression
+{
+	None,
+	Gzip,
+	Zstd
+};
+
+// Sequential reader of a file that may be compressed. Compressed data is decoded as it is read,
+// so only the blocks asked for are ever held in memory.
+class BlockReader
+{
+public:
+	virtual ~BlockReader() {}
+
+	// Reads up to 'size' bytes. Less than 'size' is only returned at the end of the data or on
+	// an error, see failed().
+	virtual size_t Read(char* data, size_t size) = 0;
+
+	bool failed() const { return m_failed; }
+	const std::string& error() const { return m_error; }
+
+protected:
+	void Fail(const std::string& error)
+	{
+		m_failed = true;
+		m_error = error;
+	}
+
+private:
+	bool m_failed = false;
+	std::string m_error;
+};
+
+// Looks at the first bytes of the file. Returns false if it cannot be opened.
+bool DetectCompression(const char* filename, Compression* compression);
+
+// Opens 'filename', decoding gzip and zstd data, which are recognized by their magic numbers.
+// Returns nullptr and sets 'err' if the file cannot be opened, or uses a compression this
+// build does not support.
+std::unique_ptr<BlockReader> OpenBlockReader(const char* filename, std::string* err);
+
+// Same for an already open file, like stdin, which is read without seeking and is not closed.
+// 'name' is used in error messages.
+std::unique_ptr<BlockReader> OpenBlockReader(FILE* file, const char* name, std::string* err);
+
+// Adapts a BlockReader to std::istream, reading one block at a time.
+class BlockStreamBuf : public std::streambuf
+{
+public:
+	explicit BlockStreamBuf(BlockReader* reader, size_t block_size = 1 << 16)
+		: m_reader(reader), m_buffer(block_size) {}
+
+protected:
+	virtual int_type underflow()
+	{
+		if (gptr() < egptr()) return traits_type::to_int_type(*gptr());
+		size_t size = m_reader->Read(m_buffer.data(), m_buffer.size());
+		if (size == 0) return traits_type::eof();
+		setg(m_buffer.data(), m_buffer.data(), m_buffer.data() + size);
+		return traits_type::to_int_type(*gptr());
+	}
+
+private:
+	BlockReader* m_reader;
+	std::vector<char> m_buffer;
+};
+
+#endif
@@ -170,7 +170,7 @@ static const uint64_t crc64_tab[256] = {
     UINT64_C(0x536fa08fdfd90e51), UINT64_C(0x29b7d047efec8728),
 };
 
-uint64_t crc64(uint64_t crc, const unsigned char *s, uint64_t l) {
+uint64_t crc64_bytewise(uint64_t crc, const unsigned char *s, uint64_t l) {
     uint64_t j;
 
     for (j = 0; j < l; j++) {
@@ -179,3 +179,162 @@ uint64_t crc64(uint64_t crc, const unsigned char *s, uint64_t l) {
     }
     return crc;
 }
+
+/* Slicing-by-8/16: table k gives the CRC of a byte followed by k zero bytes,
+ * so 8 or 16 input bytes are folded into the CRC with one lookup each,
+ * all independent of each other. */
+struct crc64_slice_tables {
+    uint64_t t[16][256];
+
+    crc64_slice_tables() {
+        for (int b = 0; b < 256; b++) t[0][b] = crc64_tab[b];
+        for (int k = 1; k < 16; k++) {
+            for (int b = 0; b < 256; b++) {
+                uint64_t prev = t[k - 1][b];
+                t[k][b] = crc64_tab[(uint8_t)prev] ^ (prev >> 8);
+            }
+        }
+    }
+};
+
+static const crc64_slice_tables &slice_tables() {
+    static const crc64_slice_tables tables;
+    return tables;
+}
+
+/* Compilers turn this into a single load on little endian machines. */
+static inline uint64_t load64_le(const unsigned char *s) {
+    return (uint64_t)s[0] | ((uint64_t)s[1] << 8) | ((uint64_t)s[2] << 16) |
+           ((uint64_t)s[3] << 24) | ((uint64_t)s[4] << 32) | ((uint64_t)s[5] << 40) |
+           ((uint64_t)s[6] << 48) | ((uint64_t)s[7] << 56);
+}
+
+static inline uint64_t crc64_slice_word(const uint64_t (*t)[256], uint64_t crc) {
+    return t[7][crc & 0xff] ^ t[6][(crc >> 8) & 0xff] ^
+           t[5][(crc >> 16) & 0xff] ^ t[4][(crc >> 24) & 0xff] ^
+           t[3][(crc >> 32) & 0xff] ^ t[2][(crc >> 40) & 0xff] ^
+           t[1][(crc >> 48) & 0xff] ^ t[0][crc >> 56];
+}
+
+uint64_t crc64_slice8(uint64_t crc, const unsigned char *s, uint64_t l) {
+    const uint64_t (*t)[256] = slice_tables().t;
+    for (; l >= 8; l -= 8, s += 8) {
+        crc = crc64_slice_word(t, crc ^ load64_le(s));
+    }
+    return crc64_bytewise(crc, s, l);
+}
+
+uint64_t crc64_slice16(uint64_t crc, const unsigned char *s, uint64_t l) {
+    const uint64_t (*t)[256] = slice_tables().t;
+    for (; l >= 16; l -= 16, s += 16) {
+        uint64_t a = crc ^ load64_le(s);
+        uint64_t b = load64_le(s + 8);
+        crc = crc64_slice_word(t + 8, a) ^ crc64_slice_word(t, b);
+    }
+    return crc64_slice8(crc, s, l);
+}
+
+#if defined(__x86_64__) || defined(_M_X64) || defined(__i386__) || defined(_M_IX86)
+#define CRC64_HAVE_CLMUL 1
+
+#include <emmintrin.h>
+#include <wmmintrin.h>
+#ifdef _MSC_VER
+#include <intrin.h>
+#define CRC64_TARGET_CLMUL
+#else
+#include <cpuid.h>
+#define CRC64_TARGET_CLMUL __attribute__((target("sse2,pclmul")))
+#endif
+
+/* x^n mod P for the (non reflected) polynomial, bit reflected. */
+static uint64_t crc64_xpow_mod(int n) {
+    const uint64_t poly = UINT64_C(0xad93d23594c935a9);
+    uint64_t r = 1;
+    for (int i = 0; i < n; i++) r = (r << 1) ^ ((r >> 63) ? poly : 0);
+    uint64_t reflected = 0;
+    for (int i = 0; i < 64; i++) reflected |= ((r >> i) & 1) << (63 - i);
+    return reflected;
+}
+
+/* Folds a 128-bit block 'n' bits forward onto the block that follows. The
+ * low half holds the earlier (higher degree) 64 bits of the block. In the
+ * reflected domain a carry-less product comes out shifted by one bit, hence
+ * the -1 in the exponents. */
+CRC64_TARGET_CLMUL
+static inline __m128i crc64_fold(__m128i block, __m128i k) {
+    return _mm_xor_si128(_mm_clmulepi64_si128(block, k, 0x00), _mm_clmulepi64_si128(block, k, 0x11));
+}
+
+CRC64_TARGET_CLMUL
+uint64_t crc64_clmul(uint64_t crc, const unsigned char *s, uint64_t l) {
+    if (l < 64) return crc64_slice16(crc, s, l);
+
+    static const uint64_t k128[2] = { crc64_xpow_mod(128 + 64 - 1), crc64_xpow_mod(128 - 1) };
+    static const uint64_t k512[2] = { crc64_xpow_mod(512 + 64 - 1), crc64_xpow_mod(512 - 1) };
+    const __m128i fold128 = _mm_loadu_si128((const __m128i *)k128);
+    const __m128i fold512 = _mm_loadu_si128((const __m128i *)k512);
+
+    /* The initial CRC is the same as xor-ing it into the first 8 bytes. */
+    __m128i x0 = _mm_xor_si128(_mm_loadu_si128((const __m128i *)s), _mm_loadl_epi64((const __m128i *)&crc));
+    __m128i x1 = _mm_loadu_si128((const __m128i *)(s + 16));
+    __m128i x2 = _mm_loadu_si128((const __m128i *)(s + 32));
+    __m128i x3 = _mm_loadu_si128((const __m128i *)(s + 48));
+    s += 64;
+    l -= 64;
+
+    /* Four independent streams, each folded 512 bits forward. */
+    for (; l >= 64; l -= 64, s += 64) {
+        x0 = _mm_xor_si128(crc64_fold(x0, fold512), _mm_loadu_si128((const __m128i *)s));
+        x1 = _mm_xor_si128(crc64_fold(x1, fold512), _mm_loadu_si128((const __m128i *)(s + 16)));
+        x2 = _mm_xor_si128(crc64_fold(x2, fold512), _mm_loadu_si128((const __m128i *)(s + 32)));
+        x3 = _mm_xor_si128(crc64_fold(x3, fold512), _mm_loadu_si128((const __m128i *)(s + 48)));
+    }
+
+    x1 = _mm_xor_si128(crc64_fold(x0, fold128), x1);
+    x2 = _mm_xor_si128(crc64_fold(x1, fold128), x2);
+    x3 = _mm_xor_si128(crc64_fold(x2, fold128), x3);
+    for (; l >= 16; l -= 16, s += 16) {
+        x3 = _mm_xor_si128(crc64_fold(x3, fold128), _mm_loadu_si128((const __m128i *)s));
+    }
+
+    /* The CRC of the remaining block is its table CRC from zero. */
+    unsigned char last[16];
+    _mm_storeu_si128((__m128i *)last, x3);
+    return crc64_slice16(crc64_slice16(0, last, 16), s, l);
+}
+
+int crc64_has_clmul(void) {
+#ifdef _MSC_VER
+    int info[4];
+    __cpuid(info, 1);
+    return (info[2] >> 1) & 1;
+#else
+    unsigned int eax, ebx, ecx, edx;
+    if (!__get_cpuid(1, &eax, &ebx, &ecx, &edx)) return 0;
+    return (ecx & bit_PCLMUL) != 0;
+#endif
+}
+
+#else
+
+uint64_t crc64_clmul(uint64_t crc, const unsigned char *s, uint64_t l) {
+    return crc64_slice16(crc, s, l);
+}
+
+int crc64_has_clmul(void) {
+    return 0;
+}
+
+#endif
+
+typedef uint64_t (*crc64_func)(uint64_t crc, const unsigned char *s, uint64_t l);
+
+static crc64_func crc64_select(void) {
+    return crc64_has_clmul() ? crc64_clmul : crc64_slice16;
+}
+
+uint64_t crc64(uint64_t crc, const unsigned char *s, uint64_t l) {
+    static const crc64_func impl = crc64_select();
+    return impl(crc, s, l);
+}
@@ -3,6 +3,20 @@
 
 #include <cstdint>
 
+// CRC-64-Jones as in Redis, with the caller's initial value. Dispatches at runtime to the
+// fastest implementation below that the CPU supports; all of them give the same results.
 uint64_t crc64(uint64_t crc, const unsigned char *s, uint64_t l);
 
+// One table lookup per byte.
+uint64_t crc64_bytewise(uint64_t crc, const unsigned char *s, uint64_t l);
+
+// Slicing-by-8 and slicing-by-16: 8 or 16 independent table lookups per step.
+uint64_t crc64_slice8(uint64_t crc, const unsigned char *s, uint64_t l);
+uint64_t crc64_slice16(uint64_t crc, const unsigned char *s, uint64_t l);
+
+// Carry-less multiplication (PCLMULQDQ) folding, 64 bytes per step. Only call it when
+// crc64_has_clmul() is true.
+uint64_t crc64_clmul(uint64_t crc, const unsigned char *s, uint64_t l);
+int crc64_has_clmul(void);
+
 #endif
\ No newline at end of file
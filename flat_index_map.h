@@ -0,0 +1,114 @@
+#ifndef _flat_index_map_h
+#define _flat_index_map_h
+
+#include <cstdint>
+#include <cstring>
+#include <vector>
+
+// Open-addressing hash table (linear probing) that numbers distinct keys 0, 1, 2... in the
+// order they are first inserted. Keys are hashed and compared bytewise, so they must not have
+// padding, and their size must be a multiple of 4.
+template <typename Key>
+class FlatIndexMap
+{
+public:
+	// Sized so that 'expected' keys stay under half full. It grows past that.
+	explicit FlatIndexMap(size_t expected = 0)
+	{
+		Allocate(expected);
+	}
+
+	size_t size() const { return m_size; }
+
+	// Returns the number of 'key', giving it the next number if it is new.
+	int Insert(const Key& key, bool* inserted)
+	{
+		size_t i = Hash(key) & m_mask;
+		while (true)
+		{
+			Slot& slot = m_slots[i];
+			if (slot.index < 0) break;
+			if (memcmp(&slot.key, &key, sizeof(Key)) == 0)
+			{
+				*inserted = false;
+				return slot.index;
+			}
+			i = (i + 1) & m_mask;
+		}
+
+		if ((m_size + 1) * 2 > m_slots.size())
+		{
+			Grow();
+			return Insert(key, inserted);
+		}
+		m_slots[i].key = key;
+		m_slots[i].index = (int)m_size++;
+		*inserted = true;
+		return m_slots[i].index;
+	}
+
+	// The number of 'key', or -1 if it was never inserted.
+	int Find(const Key& key) const
+	{
+		size_t i = Hash(key) & m_mask;
+		while (true)
+		{
+			const Slot& slot = m_slots[i];
+			if (slot.index < 0) return -1;
+			if (memcmp(&slot.key, &key, sizeof(Key)) == 0) return slot.index;
+			i = (i + 1) & m_mask;
+		}
+	}
+
+private:
+	static_assert(sizeof(Key) % 4 == 0, "FlatIndexMap keys are hashed in 32-bit words");
+
+	struct Slot
+	{
+		Key key;
+		int index;
+	};
+
+	static uint64_t Hash(const Key& key)
+	{
+		uint32_t words[sizeof(Key) / 4];
+		memcpy(words, &key, sizeof(Key));
+		uint64_t h = 0;
+		for (size_t i = 0; i < sizeof(Key) / 4; i++)
+		{
+			h = (h ^ words[i]) * 0x9E3779B97F4A7C15ull;
+			h ^= h >> 29;
+		}
+		h *= 0xBF58476D1CE4E5B9ull;
+		return h ^ (h >> 32);
+	}
+
+	void Allocate(size_t expected)
+	{
+		size_t capacity = 16;
+		while (capacity < expected * 2) capacity *= 2;
+		m_slots.assign(capacity, Slot());
+		for (Slot& slot : m_slots) slot.index = -1;
+		m_mask = capacity - 1;
+	}
+
+	void Grow()
+	{
+		std::vector<Slot> slots;
+		slots.swap(m_slots);
+		Allocate(slots.size());
+		for (const Slot& slot : slots)
+		{
+			if (slot.index < 0) continue;
+			size_t i = Hash(slot.key) & m_mask;
+			while (m_slots[i].index >= 0) i = (i + 1) & m_mask;
+			m_slots[i] = slot;
+		}
+	}
+
+	std::vector<Slot> m_slots;
+	size_t m_mask = 0;
+	size_t m_size = 0;
+};
+
+#endif
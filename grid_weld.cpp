@@ -0,0 +1,225 @@
+#include <cfloat>
+#include <cmath>
+
+#include "grid_weld.h"
+
+// Cell coordinates are clamped to this, so neighbors stay in int range. Clamped vertices
+// share cells, which only makes them slower to compare.
+static const double s_max_cell_coord = 1 << 30;
+
+static inline float DistanceSquared(const float* a, const float* b, int n)
+{
+	float d2 = 0.0f;
+	for (int i = 0; i < n; i++)
+	{
+		float d = a[i] - b[i];
+		d2 += d * d;
+	}
+	return d2;
+}
+
+WeldGrid::WeldGrid(const tinyobj::attrib_t& attrib, const tinyobj::index_t* vertices, size_t num_vertices,
+	const WeldTolerance& tolerance)
+	: m_attrib(attrib)
+	, m_vertices(vertices)
+	, m_tolerance(tolerance)
+	, m_cells(num_vertices / 2)
+{
+	// The diagonal of the bounds over the square root of the vertex count is about the spacing
+	// of the vertices of a surface. Cells twice that hold a 4x4 patch of an even mesh: fewer
+	// cells to hash and look up, still few vertices to compare.
+	float bounds_min[3] = { FLT_MAX, FLT_MAX, FLT_MAX };
+	float bounds_max[3] = { -FLT_MAX, -FLT_MAX, -FLT_MAX };
+	for (size_t v = 0; v < num_vertices; v++)
+	{
+		const float* p = &attrib.vertices[3 * (size_t)vertices[v].vertex_index];
+		for (int i = 0; i < 3; i++)
+		{
+			if (p[i] < bounds_min[i]) bounds_min[i] = p[i];
+			if (p[i] > bounds_max[i]) bounds_max[i] = p[i];
+		}
+	}
+	double cell_size = tolerance.position;
+	if (num_vertices > 1)
+	{
+		double diagonal = 0.0;
+		for (int i = 0; i < 3; i++)
+		{
+			double extent = (double)bounds_max[i] - (double)bounds_min[i];
+			diagonal += extent * extent;
+		}
+		double spacing = 2.0 * sqrt(diagonal / (double)num_vertices);
+		if (spacing > cell_size && spacing < DBL_MAX) cell_size = spacing;
+	}
+	m_inv_cell_size = 1.0 / cell_size;
+
+	// Numbers the cells in order of first use, then buckets the vertices by cell.
+	std::vector<int> vertex_cells(num_vertices);
+	m_cell_offsets.assign(1, 0);
+	for (size_t v = 0; v < num_vertices; v++)
+	{
+		bool inserted;
+		int cell = m_cells.Insert(CellOf(&attrib.vertices[3 * (size_t)vertices[v].vertex_index]), &inserted);
+		if (inserted) m_cell_offsets.push_back(0);
+		vertex_cells[v] = cell;
+		m_cell_offsets[cell + 1]++;
+	}
+	for (size_t c = 0; c + 1 < m_cell_offsets.size(); c++)
+	{
+		m_cell_offsets[c + 1] += m_cell_offsets[c];
+	}
+
+	m_cell_vertices.resize(num_vertices);
+	m_cell_positions.resize(num_vertices * 3);
+	std::vector<size_t> next(m_cell_offsets.begin(), m_cell_offsets.end() - 1);
+	for (size_t v = 0; v < num_vertices; v++)
+	{
+		size_t slot = next[vertex_cells[v]]++;
+		m_cell_vertices[slot] = (int)v;
+		const float* p = &attrib.vertices[3 * (size_t)vertices[v].vertex_index];
+		m_cell_positions[slot * 3] = p[0];
+		m_cell_positions[slot * 3 + 1] = p[1];
+		m_cell_positions[slot * 3 + 2] = p[2];
+	}
+}
+
+std::vector<size_t> WeldGrid::SplitCells(size_t range_vertices) const
+{
+	std::vector<size_t> ranges(1, 0);
+	size_t num_cells = NumCells();
+	for (size_t c = 0; c < num_cells; c++)
+	{
+		if (m_cell_offsets[c + 1] - m_cell_offsets[ranges.back()] >= range_vertices)
+		{
+			ranges.push_back(c + 1);
+		}
+	}
+	if (ranges.back() != num_cells) ranges.push_back(num_cells);
+	return ranges;
+}
+
+void WeldGrid::FindTargets(size_t cell_begin, size_t cell_end, int* targets) const
+{
+	for (size_t c = cell_begin; c < cell_end; c++)
+	{
+		CellKey key = CellOf(&m_cell_positions[m_cell_offsets[c] * 3]);
+		for (size_t slot = m_cell_offsets[c]; slot < m_cell_offsets[c + 1]; slot++)
+		{
+			int v = m_cell_vertices[slot];
+			targets[v] = FindLowest(v, &m_cell_positions[slot * 3], key, (int)c, nullptr);
+		}
+	}
+}
+
+void WeldGrid::ResolveTargets(int* targets) const
+{
+	// In vertex order, so the vertices below the current one are settled.
+	for (size_t v = 0; v < m_cell_vertices.size(); v++)
+	{
+		// The lowest vertex within tolerance is the one to move to, unless it moves itself.
+		int target = targets[v];
+		if (target == (int)v || targets[target] == target) continue;
+
+		const float* p = &m_attrib.vertices[3 * (size_t)m_vertices[v].vertex_index];
+		CellKey key = CellOf(p);
+		targets[v] = FindLowest((int)v, p, key, m_cells.Find(key), targets);
+	}
+}
+
+int WeldGrid::FindLowest(int v, const float* p, const CellKey& key, int cell_of_v, const int* targets) const
+{
+	float tolerance2 = m_tolerance.position * m_tolerance.position;
+	int low[3], high[3];
+	for (int i = 0; i < 3; i++)
+	{
+		low[i] = CellCoord((double)p[i] - m_tolerance.position);
+		high[i] = CellCoord((double)p[i] + m_tolerance.position);
+	}
+
+	int lowest = v;
+	for (int z = low[2]; z <= high[2]; z++)
+	{
+		for (int y = low[1]; y <= high[1]; y++)
+		{
+			for (int x = low[0]; x <= high[0]; x++)
+			{
+				int cell = cell_of_v;
+				if (x != key.x || y != key.y || z != key.z)
+				{
+					CellKey neighbor_key = { x, y, z };
+					cell = m_cells.Find(neighbor_key);
+					if (cell < 0) continue;
+				}
+
+				// Cells list their vertices in ascending order, so the first one that matches is
+				// the lowest of the cell, and there is nothing to find past the lowest so far.
+				for (size_t candidate = m_cell_offsets[cell]; candidate < m_cell_offsets[cell + 1]; candidate++)
+				{
+					int u = m_cell_vertices[candidate];
+					if (u >= lowest) break;
+					if (targets && targets[u] != u) continue;
+					if (DistanceSquared(&m_cell_positions[candidate * 3], p, 3) <= tolerance2 && AttributesMatch(u, v))
+					{
+						lowest = u;
+						break;
+					}
+				}
+			}
+		}
+	}
+	return lowest;
+}
+
+int WeldGrid::CellCoord(double x) const
+{
+	double q = floor(x * m_inv_cell_size);
+	// Written so that NaN goes to the lower bound.
+	q = q > s_max_cell_coord ? s_max_cell_coord : (q >= -s_max_cell_coord ? q : -s_max_cell_coord);
+	return (int)q;
+}
+
+WeldGrid::CellKey WeldGrid::CellOf(const float* p) const
+{
+	CellKey key = { CellCoord(p[0]), CellCoord(p[1]), CellCoord(p[2]) };
+	return key;
+}
+
+bool WeldGrid::AttributesMatch(int a, int b) const
+{
+	const tinyobj::index_t& index_a = m_vertices[a];
+	const tinyobj::index_t& index_b = m_vertices[b];
+
+	if (m_attrib.normals.size() > 0 && index_a.normal_index != index_b.normal_index)
+	{
+		const float* na = &m_attrib.normals[3 * (size_t)index_a.normal_index];
+		const float* nb = &m_attrib.normals[3 * (size_t)index_b.normal_index];
+		if (DistanceSquared(na, nb, 3) > m_tolerance.normal * m_tolerance.normal) return false;
+	}
+
+	if (m_attrib.texcoords.size() > 0 && index_a.texcoord_index != index_b.texcoord_index)
+	{
+		const float* ta = &m_attrib.texcoords[2 * (size_t)index_a.texcoord_index];
+		const float* tb = &m_attrib.texcoords[2 * (size_t)index_b.texcoord_index];
+		if (DistanceSquared(ta, tb, 2) > m_tolerance.texcoord * m_tolerance.texcoord) return false;
+	}
+
+	// Vertex colors are not blended, so they have to match.
+	if (m_attrib.colors.size() > 0 && index_a.vertex_index != index_b.vertex_index)
+	{
+		const float* ca = &m_attrib.colors[3 * (size_t)index_a.vertex_index];
+		const float* cb = &m_attrib.colors[3 * (size_t)index_b.vertex_index];
+		if (ca[0] != cb[0] || ca[1] != cb[1] || ca[2] != cb[2]) return false;
+	}
+	return true;
+}
+
+int CollapseTargets(int* targets, size_t num_vertices)
+{
+	// A target is lower numbered and stays, so it already has its new number.
+	int num_left = 0;
+	for (size_t v = 0; v < num_vertices; v++)
+	{
+		targets[v] = targets[v] == (int)v ? num_left++ : targets[targets[v]];
+	}
+	return num_left;
+}
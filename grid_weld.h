@@ -0,0 +1,70 @@
+#ifndef _grid_weld_h
+#define _grid_weld_h
+
+#include <vector>
+#include "tiny_obj_loader.h"
+#include "flat_index_map.h"
+
+// Largest distances at which vertices are welded. A tolerance of 0 means equal values.
+struct WeldTolerance
+{
+	float position = 0.0f;
+	float normal = 0.0f;
+	float texcoord = 0.0f;
+};
+
+// Uniform spatial hash grid over the vertices of a primitive. Cells are at least the size of
+// the position tolerance, so the vertices close enough to one are in the cells its tolerance box
+// overlaps, and on meshes sparser than the tolerance they are as big as the typical spacing of
+// the vertices, so the box rarely leaves the vertex's own cell. The position tolerance must be > 0.
+class WeldGrid
+{
+public:
+	WeldGrid(const tinyobj::attrib_t& attrib, const tinyobj::index_t* vertices, size_t num_vertices,
+		const WeldTolerance& tolerance);
+
+	size_t NumCells() const { return m_cell_offsets.size() - 1; }
+
+	// Splits the cells into ranges of about 'range_vertices' vertices. Returns the first cell
+	// of each range, followed by NumCells().
+	std::vector<size_t> SplitCells(size_t range_vertices) const;
+
+	// For each vertex in cells [cell_begin, cell_end), writes to 'targets' the lowest numbered
+	// vertex within tolerance of it, which may be itself. Ranges can run concurrently.
+	void FindTargets(size_t cell_begin, size_t cell_end, int* targets) const;
+
+	// Once all the targets are found, retargets the vertices whose target moves on to another
+	// vertex, to the lowest numbered vertex within tolerance that stays. Vertices are only moved
+	// onto vertices that stay, so none moves further than the tolerance.
+	void ResolveTargets(int* targets) const;
+
+private:
+	struct CellKey
+	{
+		int x, y, z;
+	};
+
+	// Lowest numbered vertex within tolerance of vertex 'v' at 'p' in cell 'cell_of_v', or 'v'.
+	// Given 'targets', only vertices that are their own target count.
+	int FindLowest(int v, const float* p, const CellKey& key, int cell_of_v, const int* targets) const;
+	int CellCoord(double x) const;
+	CellKey CellOf(const float* p) const;
+	bool AttributesMatch(int a, int b) const;
+
+	const tinyobj::attrib_t& m_attrib;
+	const tinyobj::index_t* m_vertices;
+	WeldTolerance m_tolerance;
+	double m_inv_cell_size;
+
+	FlatIndexMap<CellKey> m_cells;
+	std::vector<size_t> m_cell_offsets; // into m_cell_vertices, per cell and one past the last
+	std::vector<int> m_cell_vertices; // vertices by cell, ascending within each
+	std::vector<float> m_cell_positions; // their positions, 3 per vertex
+};
+
+// Moves every vertex onto its target, the targets being lower numbered vertices that are their
+// own targets (or the vertex itself). The vertices left keep their order. Replaces each target
+// with the new number of its vertex, and returns the number of vertices left.
+int CollapseTargets(int* targets, size_t num_vertices);
+
+#endif
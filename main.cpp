@@ -1,17 +1,43 @@
 #include <string>
 #include <vector>
 #include <unordered_map>
+#include <map>
+#include <tuple>
+#include <deque>
+#include <algorithm>
+#include <atomic>
+#include <iterator>
+#include <memory>
+#include <iostream>
+#include <cfloat>
+#include <climits>
 #include <glm.hpp>
 
-#define TINYOBJLOADER_IMPLEMENTATION
-#include "tiny_obj_loader.h"
+#if defined(__SSE2__) || defined(_M_X64) || defined(_M_AMD64)
+#define OBJ2GLB_SSE2 1
+#include <emmintrin.h>
+#endif
+
+#ifdef _WIN32
+#include <io.h>
+#include <fcntl.h>
+#endif
+
+#include "obj_loader.h"
+#include "obj_cache.h"
+#include "mesh_loader.h"
+#include "block_reader.h"
+#include "task_queue.h"
+#include "mapped_file.h"
+#include "sort_weld.h"
+#include "grid_weld.h"
 
 #define STB_IMAGE_IMPLEMENTATION
 #define STB_IMAGE_WRITE_IMPLEMENTATION
 #define TINYGLTF_IMPLEMENTATION
 #include <tiny_gltf.h>
 
-#include "crc64.h"
+#include "flat_index_map.h"
 
 inline bool exists_test(const char* name)
 {
@@ -27,48 +53,1067 @@ inline bool exists_test(const char* name)
 }
 
 
+// Distinct v/vn/vt triples, in order of first use, and where their attributes go in the
+// output buffer.
+struct VertexPool
+{
+	std::vector<tinyobj::index_t> vertices;
+
+	// Set when the vertices are gathered into the output buffer.
+	size_t offset_positions = 0;
+	size_t offset_normals = 0;
+	size_t offset_colors = 0;
+	size_t offset_texcoords = 0;
+	glm::vec3 min_pos;
+	glm::vec3 max_pos;
+};
+
+struct Primitive
+{
+	int material;
+	std::vector<glm::ivec3> indices;
+	VertexPool pool; // unused when the mesh shares its vertices
+
+	// Set when the indices are copied into the output buffer.
+	size_t offset_indices = 0;
+	int min_index = 0;
+	int max_index = -1;
+};
+
+struct Mesh
+{
+	std::string name;
+	std::vector<Primitive> primitives;
+
+	// With shared vertices, the faces of all primitives are welded together into 'shared',
+	// whose pool is then the one all primitives index. Its faces are handed out to the
+	// primitives once any tolerance weld is done.
+	bool shared_vertices = false;
+	Primitive shared;
+};
+
+// The vertices 'prim' of 'mesh' indexes.
+static VertexPool& PoolOf(Mesh& mesh, Primitive& prim)
+{
+	return mesh.shared_vertices ? mesh.shared.pool : prim.pool;
+}
+
+// Primitives with more faces than this are welded in ranges of this size on separate tasks.
+static const size_t s_weld_range_faces = 1 << 17;
+
+enum class WeldMode
+{
+	Auto,	// sort for primitives with more corners than s_sort_weld_corners, else hash
+	Hash,
+	Sort
+};
+
+// Past this, the table for merging the ranges of a hash weld is far larger than the cache.
+static const size_t s_sort_weld_corners = 1 << 24;
+
+// Running min/max of the positions, 4 lanes at a time where SSE2 is available.
+struct Bounds
+{
+#ifdef OBJ2GLB_SSE2
+	__m128 min = _mm_set1_ps(FLT_MAX);
+	__m128 max = _mm_set1_ps(-FLT_MAX);
+
+	void Add(const float* p)
+	{
+		__m128 pos = _mm_setr_ps(p[0], p[1], p[2], p[2]);
+		min = _mm_min_ps(pos, min);
+		max = _mm_max_ps(pos, max);
+	}
+
+	void Get(glm::vec3* min_out, glm::vec3* max_out) const
+	{
+		float lanes[4];
+		_mm_storeu_ps(lanes, min);
+		*min_out = glm::vec3(lanes[0], lanes[1], lanes[2]);
+		_mm_storeu_ps(lanes, max);
+		*max_out = glm::vec3(lanes[0], lanes[1], lanes[2]);
+	}
+#else
+	glm::vec3 min = { FLT_MAX, FLT_MAX, FLT_MAX };
+	glm::vec3 max = { -FLT_MAX, -FLT_MAX, -FLT_MAX };
+
+	void Add(const float* p)
+	{
+		glm::vec3 pos(p[0], p[1], p[2]);
+		min = glm::min(min, pos);
+		max = glm::max(max, pos);
+	}
+
+	void Get(glm::vec3* min_out, glm::vec3* max_out) const
+	{
+		*min_out = min;
+		*max_out = max;
+	}
+#endif
+};
+
+// Copies the indices of 'prim' to their offset in 'buffer', finding the range of vertices
+// they use on the way.
+static void CopyIndices(Primitive* prim, uint8_t* buffer)
+{
+	int* indices_out = (int*)(buffer + prim->offset_indices);
+	const int* indices = (const int*)prim->indices.data();
+	size_t num_indices = prim->indices.size() * 3;
+	int min_index = INT_MAX;
+	int max_index = -1;
+	for (size_t i = 0; i < num_indices; i++)
+	{
+		int index = indices[i];
+		indices_out[i] = index;
+		if (index < min_index) min_index = index;
+		if (index > max_index) max_index = index;
+	}
+	prim->min_index = num_indices > 0 ? min_index : 0;
+	prim->max_index = max_index;
+}
+
+// Writes the attributes of the vertices of 'pool' at their offsets in 'buffer', and finds the
+// bounds of the positions on the way. There is one instance per combination of attributes
+// present, so the loop has no per-vertex branches.
+template <bool has_normals, bool has_colors, bool has_texcoords>
+static void GatherVertices(const tinyobj::attrib_t& attrib, VertexPool* pool, uint8_t* buffer)
+{
+	const float* positions_in = attrib.vertices.data();
+	const float* normals_in = attrib.normals.data();
+	const float* colors_in = attrib.colors.data();
+	const float* texcoords_in = attrib.texcoords.data();
+	float* positions = (float*)(buffer + pool->offset_positions);
+	float* normals = (float*)(buffer + pool->offset_normals);
+	float* colors = (float*)(buffer + pool->offset_colors);
+	float* texcoords = (float*)(buffer + pool->offset_texcoords);
+
+	Bounds bounds;
+	size_t num_vertices = pool->vertices.size();
+	for (size_t v = 0; v < num_vertices; v++)
+	{
+		const tinyobj::index_t& index = pool->vertices[v];
+
+		const float* vp = positions_in + 3 * (size_t)index.vertex_index;
+		positions[3 * v] = vp[0];
+		positions[3 * v + 1] = vp[1];
+		positions[3 * v + 2] = vp[2];
+		bounds.Add(vp);
+
+		if (has_normals)
+		{
+			const float* np = normals_in + 3 * (size_t)index.normal_index;
+			normals[3 * v] = np[0];
+			normals[3 * v + 1] = np[1];
+			normals[3 * v + 2] = np[2];
+		}
+
+		if (has_colors)
+		{
+			const float* cp = colors_in + 3 * (size_t)index.vertex_index;
+			colors[3 * v] = glm::clamp(cp[0], 0.0f, 1.0f);
+			colors[3 * v + 1] = glm::clamp(cp[1], 0.0f, 1.0f);
+			colors[3 * v + 2] = glm::clamp(cp[2], 0.0f, 1.0f);
+		}
+
+		if (has_texcoords)
+		{
+			const float* tp = texcoords_in + 2 * (size_t)index.texcoord_index;
+			texcoords[2 * v] = tp[0];
+			texcoords[2 * v + 1] = 1.0f - tp[1];
+		}
+	}
+	bounds.Get(&pool->min_pos, &pool->max_pos);
+}
+
+typedef void (*GatherFunc)(const tinyobj::attrib_t& attrib, VertexPool* pool, uint8_t* buffer);
+
+// The GatherVertices instance for the attributes of 'attrib'.
+static GatherFunc SelectGather(const tinyobj::attrib_t& attrib)
+{
+	static const GatherFunc s_gathers[8] =
+	{
+		GatherVertices<false, false, false>,
+		GatherVertices<true, false, false>,
+		GatherVertices<false, true, false>,
+		GatherVertices<true, true, false>,
+		GatherVertices<false, false, true>,
+		GatherVertices<true, false, true>,
+		GatherVertices<false, true, true>,
+		GatherVertices<true, true, true>
+	};
+	int i = (attrib.normals.size() > 0 ? 1 : 0) | (attrib.colors.size() > 0 ? 2 : 0) | (attrib.texcoords.size() > 0 ? 4 : 0);
+	return s_gathers[i];
+}
+
+// Corners that use the same v/vt/vn indices are welded into one vertex. Vertices are numbered
+// in the order of their first use.
+static void WeldFaces(const tinyobj::shape_t& shape, const int* faces, size_t num_faces, Primitive* prim_out)
+{
+	FlatIndexMap<tinyobj::index_t> ind_map(num_faces);
+	prim_out->indices.resize(num_faces);
+	for (size_t f = 0; f < num_faces; f++)
+	{
+		int j = faces[f];
+		glm::ivec3& cur_ind = prim_out->indices[f];
+		for (int k = 0; k < 3; k++)
+		{
+			const tinyobj::index_t& index = shape.mesh.indices[j * 3 + k];
+			bool inserted;
+			cur_ind[k] = ind_map.Insert(index, &inserted);
+			if (inserted) prim_out->pool.vertices.push_back(index);
+		}
+	}
+}
+
+// Same as WeldFaces, by sorting the corners instead of hashing them.
+static void SortWeldFaces(const tinyobj::shape_t& shape, const int* faces, size_t num_faces, Primitive* prim_out)
+{
+	std::vector<int> corners(num_faces * 3);
+	SortWeld(shape.mesh.indices.data(), faces, num_faces, &prim_out->pool.vertices, corners.data());
+
+	prim_out->indices.resize(num_faces);
+	for (size_t f = 0; f < num_faces; f++)
+	{
+		const int* corner = &corners[f * 3];
+		prim_out->indices[f] = glm::ivec3(corner[0], corner[1], corner[2]);
+	}
+}
+
+// A large primitive welded in ranges of faces. Each range is welded on its own, then the
+// last range to finish merges them in order: a vertex is new to the primitive when no earlier
+// range used it, which numbers the vertices exactly as welding all faces in one go would.
+struct SplitWeld
+{
+	struct Range
+	{
+		size_t begin;
+		size_t end;
+		std::vector<tinyobj::index_t> vertices; // distinct corners, in order of first use
+		std::vector<int> corners; // into 'vertices'
+	};
+
+	const tinyobj::shape_t* shape;
+	std::shared_ptr<const std::vector<int>> faces;
+	Primitive* prim_out;
+	std::vector<Range> ranges;
+	std::atomic<size_t> num_pending;
+
+	void WeldRange(Range& range)
+	{
+		size_t num_faces = range.end - range.begin;
+		FlatIndexMap<tinyobj::index_t> ind_map(num_faces);
+		range.corners.resize(num_faces * 3);
+		for (size_t f = 0; f < num_faces; f++)
+		{
+			int j = (*faces)[range.begin + f];
+			for (int k = 0; k < 3; k++)
+			{
+				const tinyobj::index_t& index = shape->mesh.indices[j * 3 + k];
+				bool inserted;
+				range.corners[f * 3 + k] = ind_map.Insert(index, &inserted);
+				if (inserted) range.vertices.push_back(index);
+			}
+		}
+	}
+
+	void Merge()
+	{
+		FlatIndexMap<tinyobj::index_t> ind_map(faces->size() / 2);
+		prim_out->indices.resize(faces->size());
+		glm::ivec3* indices = prim_out->indices.data();
+		std::vector<int> remap;
+		for (Range& range : ranges)
+		{
+			remap.resize(range.vertices.size());
+			for (size_t v = 0; v < range.vertices.size(); v++)
+			{
+				bool inserted;
+				remap[v] = ind_map.Insert(range.vertices[v], &inserted);
+				if (inserted) prim_out->pool.vertices.push_back(range.vertices[v]);
+			}
+			for (size_t f = 0; f < range.end - range.begin; f++)
+			{
+				const int* corner = &range.corners[f * 3];
+				indices[range.begin + f] = glm::ivec3(remap[corner[0]], remap[corner[1]], remap[corner[2]]);
+			}
+			std::vector<tinyobj::index_t>().swap(range.vertices);
+			std::vector<int>().swap(range.corners);
+		}
+	}
+};
+
+// Cell ranges of a primitive's tolerance weld hold about this many vertices each, and are
+// searched on separate tasks.
+static const size_t s_grid_weld_range_vertices = 1 << 16;
+
+// Welds the vertices of a primitive that are within tolerance of each other, after the exact
+// weld. Each vertex is moved onto the lowest numbered one within tolerance that stays, found on
+// the spatial grid in parallel over ranges of cells, then the last range to finish settles the
+// vertices whose first match moved on, and renumbers them.
+struct GridWeld
+{
+	Primitive* prim;
+	std::unique_ptr<WeldGrid> grid;
+	std::vector<int> targets;
+	std::atomic<size_t> num_pending;
+
+	void Finish()
+	{
+		grid->ResolveTargets(targets.data());
+		grid.reset();
+		int num_left = CollapseTargets(targets.data(), targets.size());
+		for (glm::ivec3& face : prim->indices)
+		{
+			face = glm::ivec3(targets[face[0]], targets[face[1]], targets[face[2]]);
+		}
+
+		// A vertex that is left is the first to get its new number.
+		std::vector<tinyobj::index_t>& vertices = prim->pool.vertices;
+		int num_kept = 0;
+		for (size_t v = 0; v < vertices.size(); v++)
+		{
+			if (targets[v] == num_kept) vertices[num_kept++] = vertices[v];
+		}
+		vertices.resize(num_left);
+	}
+};
+
+static void GridWeldPrimitive(TaskQueue* queue, const tinyobj::attrib_t& attrib, const WeldTolerance& tolerance, Primitive* prim)
+{
+	std::shared_ptr<GridWeld> weld = std::make_shared<GridWeld>();
+	weld->prim = prim;
+	const std::vector<tinyobj::index_t>& vertices = prim->pool.vertices;
+	weld->grid.reset(new WeldGrid(attrib, vertices.data(), vertices.size(), tolerance));
+	weld->targets.resize(vertices.size());
+
+	std::vector<size_t> ranges = weld->grid->SplitCells(s_grid_weld_range_vertices);
+	weld->num_pending = ranges.size() - 1;
+	for (size_t r = 0; r + 1 < ranges.size(); r++)
+	{
+		size_t cell_begin = ranges[r];
+		size_t cell_end = ranges[r + 1];
+		queue->Push([weld, cell_begin, cell_end]()
+		{
+			weld->grid->FindTargets(cell_begin, cell_end, weld->targets.data());
+			if (--weld->num_pending == 0) weld->Finish();
+		});
+	}
+}
+
+// Faces of a primitive are cleaned up in ranges of this many on separate tasks.
+static const size_t s_cleanup_range_faces = 1 << 16;
+
+// Most tasks the duplicate search of a primitive is split into. Each one scans all the faces.
+static const size_t s_max_cleanup_partitions = 8;
+
+// Faces sharing their lowest vertex are compared pairwise up to this many, sorted past it.
+static const size_t s_max_scan_bucket = 32;
+
+// Drops the vertices of 'pool' that no face of 'primitives' uses, keeping the order of the
+// others, and renumbers the faces to match.
+static void CompactVertices(VertexPool* pool, Primitive* primitives, size_t num_primitives)
+{
+	std::vector<int> remap(pool->vertices.size(), -1);
+	for (size_t i = 0; i < num_primitives; i++)
+	{
+		for (const glm::ivec3& face : primitives[i].indices)
+		{
+			for (int k = 0; k < 3; k++) remap[face[k]] = 0;
+		}
+	}
+	int num_used = 0;
+	for (size_t v = 0; v < remap.size(); v++)
+	{
+		if (remap[v] < 0) continue;
+		pool->vertices[num_used] = pool->vertices[v];
+		remap[v] = num_used++;
+	}
+	if ((size_t)num_used == remap.size()) return;
+	pool->vertices.resize(num_used);
+	for (size_t i = 0; i < num_primitives; i++)
+	{
+		for (glm::ivec3& face : primitives[i].indices)
+		{
+			face = glm::ivec3(remap[face[0]], remap[face[1]], remap[face[2]]);
+		}
+	}
+}
+
+struct CleanupCounts
+{
+	std::atomic<size_t> degenerate{ 0 };
+	std::atomic<size_t> duplicate{ 0 };
+};
+
+// Drops the triangles of a primitive that use a vertex twice or have an area of at most
+// 'min_area', then the ones with the same three vertices as an earlier triangle, whatever their
+// order: materials are double sided, so a flipped copy is as redundant as a rotated one.
+// Faces are classified in ranges, with their vertices sorted. Copies share their lowest vertex,
+// so duplicates are found by bucketing the faces on it (a counting sort, in face order, so the
+// first copy is the one kept), in partitions of the range of vertices the faces use. The last
+// partition to finish compacts the faces, and the vertices still used unless they are shared.
+struct TriangleCleanup
+{
+	enum : uint8_t
+	{
+		Keep,
+		Degenerate,
+		Duplicate
+	};
+
+	struct TriangleKey
+	{
+		int a, b, c;
+	};
+
+	const tinyobj::attrib_t* attrib;
+	VertexPool* pool;
+	Primitive* prim;
+	int vertex_begin;
+	int vertex_end;
+	float min_area;
+	CleanupCounts* counts;
+	std::vector<uint8_t> states;
+	std::vector<TriangleKey> keys;
+	size_t num_partitions;
+	std::atomic<size_t> num_pending;
+
+	void Classify(size_t begin, size_t end)
+	{
+		const float* positions = attrib->vertices.data();
+		for (size_t f = begin; f < end; f++)
+		{
+			const glm::ivec3& face = prim->indices[f];
+			int a = face[0], b = face[1], c = face[2];
+			if (a == b || b == c || c == a)
+			{
+				states[f] = Degenerate;
+				continue;
+			}
+
+			const float* pa = positions + 3 * (size_t)pool->vertices[a].vertex_index;
+			const float* pb = positions + 3 * (size_t)pool->vertices[b].vertex_index;
+			const float* pc = positions + 3 * (size_t)pool->vertices[c].vertex_index;
+			glm::vec3 ab(pb[0] - pa[0], pb[1] - pa[1], pb[2] - pa[2]);
+			glm::vec3 ac(pc[0] - pa[0], pc[1] - pa[1], pc[2] - pa[2]);
+			if (0.5f * glm::length(glm::cross(ab, ac)) <= min_area)
+			{
+				states[f] = Degenerate;
+				continue;
+			}
+
+			if (a > b) std::swap(a, b);
+			if (b > c) std::swap(b, c);
+			if (a > b) std::swap(a, b);
+			keys[f] = { a, b, c };
+			states[f] = Keep;
+		}
+	}
+
+	static bool SameKey(const TriangleKey& x, const TriangleKey& y)
+	{
+		return x.b == y.b && x.c == y.c;
+	}
+
+	void FindDuplicates(size_t partition)
+	{
+		size_t num_vertices = (size_t)(this->vertex_end - this->vertex_begin);
+		int vertex_begin = this->vertex_begin + (int)(num_vertices * partition / num_partitions);
+		int vertex_end = this->vertex_begin + (int)(num_vertices * (partition + 1) / num_partitions);
+		size_t num_faces = keys.size();
+
+		// Only the states of the faces of this partition are read, the others may be changing.
+		std::vector<size_t> offsets(vertex_end - vertex_begin + 1, 0);
+		for (size_t f = 0; f < num_faces; f++)
+		{
+			int a = keys[f].a;
+			if (a >= vertex_begin && a < vertex_end && states[f] == Keep) offsets[a - vertex_begin + 1]++;
+		}
+		for (size_t i = 1; i < offsets.size(); i++)
+		{
+			offsets[i] += offsets[i - 1];
+		}
+		std::vector<int> bucket_faces(offsets.back());
+		{
+			std::vector<size_t> next(offsets.begin(), offsets.end() - 1);
+			for (size_t f = 0; f < num_faces; f++)
+			{
+				int a = keys[f].a;
+				if (a >= vertex_begin && a < vertex_end && states[f] == Keep) bucket_faces[next[a - vertex_begin]++] = (int)f;
+			}
+		}
+
+		for (size_t i = 0; i + 1 < offsets.size(); i++)
+		{
+			int* begin = bucket_faces.data() + offsets[i];
+			int* end = bucket_faces.data() + offsets[i + 1];
+			if (end - begin <= (ptrdiff_t)s_max_scan_bucket)
+			{
+				for (int* f = begin + 1; f < end; f++)
+				{
+					for (int* g = begin; g < f; g++)
+					{
+						if (states[*g] == Keep && SameKey(keys[*f], keys[*g]))
+						{
+							states[*f] = Duplicate;
+							break;
+						}
+					}
+				}
+				continue;
+			}
+
+			std::sort(begin, end, [this](int f, int g)
+			{
+				const TriangleKey& x = keys[f];
+				const TriangleKey& y = keys[g];
+				if (x.b != y.b) return x.b < y.b;
+				if (x.c != y.c) return x.c < y.c;
+				return f < g;
+			});
+			for (int* f = begin + 1; f < end; f++)
+			{
+				if (SameKey(keys[*f], keys[f[-1]])) states[*f] = Duplicate;
+			}
+		}
+	}
+
+	void Finish()
+	{
+		size_t num_degenerate = 0;
+		size_t num_duplicate = 0;
+		size_t num_kept = 0;
+		std::vector<glm::ivec3>& indices = prim->indices;
+		for (size_t f = 0; f < indices.size(); f++)
+		{
+			if (states[f] == Degenerate) num_degenerate++;
+			else if (states[f] == Duplicate) num_duplicate++;
+			else indices[num_kept++] = indices[f];
+		}
+		counts->degenerate += num_degenerate;
+		counts->duplicate += num_duplicate;
+		if (num_kept == indices.size()) return;
+		indices.resize(num_kept);
+
+		// A shared pool is compacted once all the primitives using it are cleaned up.
+		if (pool == &prim->pool) CompactVertices(pool, prim, 1);
+	}
+};
+
+static void CleanupPrimitive(TaskQueue* queue, const tinyobj::attrib_t& attrib, float min_area, CleanupCounts* counts,
+	VertexPool* pool, Primitive* prim)
+{
+	size_t num_faces = prim->indices.size();
+	std::shared_ptr<TriangleCleanup> cleanup = std::make_shared<TriangleCleanup>();
+	cleanup->attrib = &attrib;
+	cleanup->pool = pool;
+	cleanup->prim = prim;
+	cleanup->vertex_begin = 0;
+	cleanup->vertex_end = (int)pool->vertices.size();
+	if (pool != &prim->pool)
+	{
+		// A primitive uses a small part of a shared pool, mostly in one stretch.
+		int vertex_begin = INT_MAX;
+		int vertex_end = 0;
+		for (const glm::ivec3& face : prim->indices)
+		{
+			for (int k = 0; k < 3; k++)
+			{
+				if (face[k] < vertex_begin) vertex_begin = face[k];
+				if (face[k] >= vertex_end) vertex_end = face[k] + 1;
+			}
+		}
+		cleanup->vertex_begin = std::min(vertex_begin, vertex_end);
+		cleanup->vertex_end = vertex_end;
+	}
+	cleanup->min_area = min_area;
+	cleanup->counts = counts;
+	cleanup->states.resize(num_faces);
+	cleanup->keys.resize(num_faces);
+	size_t num_ranges = (num_faces + s_cleanup_range_faces - 1) / s_cleanup_range_faces;
+	cleanup->num_partitions = std::max(std::min(num_ranges, s_max_cleanup_partitions), (size_t)1);
+	if (num_ranges <= 1)
+	{
+		cleanup->Classify(0, num_faces);
+		cleanup->FindDuplicates(0);
+		cleanup->Finish();
+		return;
+	}
+
+	// Classifies the ranges, then the last one to finish starts the duplicate search.
+	cleanup->num_pending = num_ranges;
+	for (size_t r = 0; r < num_ranges; r++)
+	{
+		size_t begin = r * s_cleanup_range_faces;
+		size_t end = std::min(begin + s_cleanup_range_faces, num_faces);
+		queue->Push([queue, cleanup, begin, end]()
+		{
+			cleanup->Classify(begin, end);
+			if (--cleanup->num_pending > 0) return;
+
+			cleanup->num_pending = cleanup->num_partitions;
+			for (size_t p = 0; p < cleanup->num_partitions; p++)
+			{
+				queue->Push([cleanup, p]()
+				{
+					cleanup->FindDuplicates(p);
+					if (--cleanup->num_pending == 0) cleanup->Finish();
+				});
+			}
+		});
+	}
+}
+
+// Welds faces [begin, begin + count) of 'faces' into 'prim_out', as tasks on 'queue'.
+static void WeldPrimitive(TaskQueue* queue, WeldMode weld_mode, const tinyobj::shape_t& shape,
+	const std::shared_ptr<std::vector<int>>& faces, size_t begin, size_t count, Primitive* prim_out)
+{
+	if (weld_mode == WeldMode::Sort || (weld_mode == WeldMode::Auto && count * 3 > s_sort_weld_corners))
+	{
+		queue->Push([&shape, faces, begin, count, prim_out]()
+		{
+			SortWeldFaces(shape, faces->data() + begin, count, prim_out);
+		});
+		return;
+	}
+	if (count <= s_weld_range_faces)
+	{
+		queue->Push([&shape, faces, begin, count, prim_out]()
+		{
+			WeldFaces(shape, faces->data() + begin, count, prim_out);
+		});
+		return;
+	}
+
+	std::shared_ptr<SplitWeld> split = std::make_shared<SplitWeld>();
+	split->shape = &shape;
+	split->faces = std::make_shared<const std::vector<int>>(faces->begin() + begin, faces->begin() + begin + count);
+	split->prim_out = prim_out;
+	for (size_t r = 0; r < count; r += s_weld_range_faces)
+	{
+		SplitWeld::Range range;
+		range.begin = r;
+		range.end = std::min(r + s_weld_range_faces, count);
+		split->ranges.push_back(std::move(range));
+	}
+	split->num_pending = split->ranges.size();
+	for (size_t r = 0; r < split->ranges.size(); r++)
+	{
+		queue->Push([split, r]()
+		{
+			split->WeldRange(split->ranges[r]);
+			if (--split->num_pending == 0) split->Merge();
+		});
+	}
+}
+
+// Splits the faces of a shape into one primitive per material and welds them, as tasks on
+// 'queue'. The indices and vertices of the primitives are complete once the queue is done;
+// the attributes are only gathered into the output buffer. With 'shared_vertices', the faces
+// of a shape with several materials are welded together into mesh_out->shared instead.
+static void BuildMesh(TaskQueue* queue, WeldMode weld_mode, bool shared_vertices, const tinyobj::shape_t& shape, Mesh* mesh_out)
+{
+	mesh_out->name = shape.name;
+
+	std::vector<Primitive>& primitives = mesh_out->primitives;
+	std::unordered_map<int, int> material_prim_map;
+
+	// Buckets the faces by primitive in one counting-sort pass, keeping the file order
+	// within each primitive. Primitives are numbered by first use of their material.
+	size_t num_faces = shape.mesh.material_ids.size();
+	std::vector<int> face_prims(num_faces);
+	std::vector<size_t> prim_offsets(1, 0);
+	int last_material = 0;
+	int last_prim = -1;
+	for (size_t j = 0; j < num_faces; j++)
+	{
+		int material_id = shape.mesh.material_ids[j];
+		if (last_prim < 0 || material_id != last_material)
+		{
+			auto iter = material_prim_map.find(material_id);
+			if (iter == material_prim_map.end())
+			{
+				int prim_id = (int)primitives.size();
+				primitives.resize(prim_id + 1);
+				Primitive& prim_out = primitives[prim_id];
+				prim_out.material = material_id;
+				iter = material_prim_map.insert({ material_id, prim_id }).first;
+				prim_offsets.push_back(0);
+			}
+			last_material = material_id;
+			last_prim = iter->second;
+		}
+		face_prims[j] = last_prim;
+		prim_offsets[last_prim + 1]++;
+	}
+
+	for (size_t i_prim = 0; i_prim < primitives.size(); i_prim++)
+	{
+		prim_offsets[i_prim + 1] += prim_offsets[i_prim];
+	}
+	std::shared_ptr<std::vector<int>> prim_faces = std::make_shared<std::vector<int>>(num_faces);
+	{
+		std::vector<size_t> next(prim_offsets.begin(), prim_offsets.end() - 1);
+		for (size_t j = 0; j < num_faces; j++)
+		{
+			(*prim_faces)[next[face_prims[j]]++] = (int)j;
+		}
+	}
+
+	if (shared_vertices && primitives.size() > 1)
+	{
+		// The faces are bucketed by primitive, so each one's part of the welded faces follows the last.
+		mesh_out->shared_vertices = true;
+		for (size_t i_prim = 0; i_prim < primitives.size(); i_prim++)
+		{
+			primitives[i_prim].indices.resize(prim_offsets[i_prim + 1] - prim_offsets[i_prim]);
+		}
+		WeldPrimitive(queue, weld_mode, shape, prim_faces, 0, num_faces, &mesh_out->shared);
+		return;
+	}
+
+	for (size_t i_prim = 0; i_prim < primitives.size(); i_prim++)
+	{
+		size_t begin = prim_offsets[i_prim];
+		size_t count = prim_offsets[i_prim + 1] - begin;
+		WeldPrimitive(queue, weld_mode, shape, prim_faces, begin, count, &primitives[i_prim]);
+	}
+}
+
+// Hands out the faces of a mesh welded together to its primitives, in order.
+static void SplitSharedFaces(Mesh* mesh)
+{
+	const glm::ivec3* faces = mesh->shared.indices.data();
+	for (Primitive& prim : mesh->primitives)
+	{
+		std::copy(faces, faces + prim.indices.size(), prim.indices.begin());
+		faces += prim.indices.size();
+	}
+	std::vector<glm::ivec3>().swap(mesh->shared.indices);
+}
+
+// The glTF mime type of an image file that viewers can read as is, a PNG or a JPEG, from
+// its header. Also reads the size and channel count. Null for anything else.
+static const char* EmbeddableMimeType(const stbi_uc* bytes, int size, int* width, int* height, int* channels)
+{
+	static const stbi_uc s_png_signature[8] = { 0x89, 'P', 'N', 'G', '\r', '\n', 0x1a, '\n' };
+	if (!stbi_info_from_memory(bytes, size, width, height, channels)) return nullptr;
+	if (size >= 8 && memcmp(bytes, s_png_signature, 8) == 0) return "image/png";
+	if (size >= 3 && bytes[0] == 0xff && bytes[1] == 0xd8 && bytes[2] == 0xff) return "image/jpeg";
+	return nullptr;
+}
+
+static void PrintUsage()
+{
+	fprintf(stderr, "obj2glb [options] input.obj output.glb\n");
+	fprintf(stderr, "input can also be a binary .ply or .stl file\n");
+	fprintf(stderr, "options:\n");
+	fprintf(stderr, "  --cache    keep the parsed .obj in a binary cache next to it (input.obj.cache),\n");
+	fprintf(stderr, "             used instead of parsing while the .obj is unchanged\n");
+	fprintf(stderr, "  --weld hash|sort|auto\n");
+	fprintf(stderr, "             how corners are welded into vertices: with a hash table, by sorting\n");
+	fprintf(stderr, "             them (less cache bound on huge meshes), or sorting only primitives\n");
+	fprintf(stderr, "             of more than %d corners (the default)\n", (int)s_sort_weld_corners);
+	fprintf(stderr, "  --weld-distance <d>\n");
+	fprintf(stderr, "             also weld vertices whose positions are at most d apart, and whose\n");
+	fprintf(stderr, "             normals and texcoords are equal or within the tolerances below\n");
+	fprintf(stderr, "  --weld-normal <d>\n");
+	fprintf(stderr, "             largest distance between the normals of vertices welded by distance\n");
+	fprintf(stderr, "  --weld-uv <d>\n");
+	fprintf(stderr, "             largest distance between the texcoords of vertices welded by distance\n");
+	fprintf(stderr, "  --shared-vertices\n");
+	fprintf(stderr, "             weld the primitives of a mesh into one set of vertices, which they\n");
+	fprintf(stderr, "             index in parts of one index array\n");
+	fprintf(stderr, "  --clean    remove triangles that use a vertex twice, have no area, or repeat an\n");
+	fprintf(stderr, "             earlier triangle of their primitive, in any vertex order\n");
+	fprintf(stderr, "  --min-area <a>\n");
+	fprintf(stderr, "             with --clean, also remove triangles with an area of at most a\n");
+	fprintf(stderr, "  --base-dir <dir>\n");
+	fprintf(stderr, "             directory of the .mtl and texture files, by default the directory\n");
+	fprintf(stderr, "             of input.obj, or the current directory when reading stdin\n");
+	fprintf(stderr, "input.obj or output.glb can be - to read stdin or write stdout\n");
+}
+
 int main(int argc, char* argv[])
 {
-	if (argc < 3)
+	const char* filename_in = nullptr;
+	const char* filename_out = nullptr;
+	const char* base_dir = nullptr;
+	bool use_cache = false;
+	WeldMode weld_mode = WeldMode::Auto;
+	WeldTolerance weld_tolerance;
+	bool shared_vertices = false;
+	bool clean = false;
+	float min_area = 0.0f;
+
+	for (int i = 1; i < argc; i++)
+	{
+		if (strcmp(argv[i], "--cache") == 0)
+		{
+			use_cache = true;
+		}
+		else if (strcmp(argv[i], "--weld") == 0 && i + 1 < argc)
+		{
+			i++;
+			if (strcmp(argv[i], "hash") == 0) weld_mode = WeldMode::Hash;
+			else if (strcmp(argv[i], "sort") == 0) weld_mode = WeldMode::Sort;
+			else if (strcmp(argv[i], "auto") == 0) weld_mode = WeldMode::Auto;
+			else
+			{
+				fprintf(stderr, "Unknown weld mode %s\n", argv[i]);
+				PrintUsage();
+				return 1;
+			}
+		}
+		else if (strcmp(argv[i], "--weld-distance") == 0 && i + 1 < argc)
+		{
+			weld_tolerance.position = (float)atof(argv[++i]);
+		}
+		else if (strcmp(argv[i], "--weld-normal") == 0 && i + 1 < argc)
+		{
+			weld_tolerance.normal = (float)atof(argv[++i]);
+		}
+		else if (strcmp(argv[i], "--weld-uv") == 0 && i + 1 < argc)
+		{
+			weld_tolerance.texcoord = (float)atof(argv[++i]);
+		}
+		else if (strcmp(argv[i], "--shared-vertices") == 0)
+		{
+			shared_vertices = true;
+		}
+		else if (strcmp(argv[i], "--clean") == 0)
+		{
+			clean = true;
+		}
+		else if (strcmp(argv[i], "--min-area") == 0 && i + 1 < argc)
+		{
+			min_area = (float)atof(argv[++i]);
+		}
+		else if (strcmp(argv[i], "--base-dir") == 0 && i + 1 < argc)
+		{
+			base_dir = argv[++i];
+		}
+		else if (argv[i][0] == '-' && argv[i][1] == '-')
+		{
+			fprintf(stderr, "Unknown option %s\n", argv[i]);
+			PrintUsage();
+			return 1;
+		}
+		else if (filename_in == nullptr)
+		{
+			filename_in = argv[i];
+		}
+		else if (filename_out == nullptr)
+		{
+			filename_out = argv[i];
+		}
+		else
+		{
+			fprintf(stderr, "Unexpected argument %s\n", argv[i]);
+			PrintUsage();
+			return 1;
+		}
+	}
+
+	if (filename_out == nullptr)
+	{
+		PrintUsage();
+		return 1;
+	}
+
+	bool from_stdin = strcmp(filename_in, "-") == 0;
+	bool to_stdout = strcmp(filename_out, "-") == 0;
+#ifdef _WIN32
+	if (from_stdin) _setmode(_fileno(stdin), _O_BINARY);
+	if (to_stdout) _setmode(_fileno(stdout), _O_BINARY);
+#endif
+
+	std::string path_model;
+	if (base_dir != nullptr)
+	{
+		path_model = std::string(base_dir) + "/";
+	}
+	else if (from_stdin)
+	{
+		path_model = "./";
+	}
+	else
 	{
-		printf("obj2glb input.obj output.glb\n");
-		return 0;
+		path_model = std::filesystem::path(filename_in).parent_path().u8string() + "/";
 	}
 
-	std::string path_model = std::filesystem::path(argv[1]).parent_path().u8string()+"/";	
-
 	tinyobj::attrib_t                attrib;
 	std::vector<tinyobj::shape_t>    shapes;
 	std::vector<tinyobj::material_t> materials;
 	std::string                      err;
 
-	tinyobj::LoadObj(&attrib, &shapes, &materials, &err, argv[1], path_model.c_str());
+	// Meshes are built on worker threads as the loader merges their shapes, overlapping with
+	// the parsing and merging of the rest of the file and with the texture loading. The loader
+	// hands the shapes over, and they are kept here until the meshes are built.
+	std::deque<Mesh> meshes;
+	std::deque<tinyobj::shape_t> loaded_shapes;
+	TaskQueue build_queue;
+	auto build_mesh = [&meshes, &build_queue, weld_mode, shared_vertices](const tinyobj::shape_t& shape)
+	{
+		meshes.emplace_back();
+		Mesh* mesh_out = &meshes.back();
+		build_queue.Push([&build_queue, weld_mode, shared_vertices, &shape, mesh_out]()
+		{
+			BuildMesh(&build_queue, weld_mode, shared_vertices, shape, mesh_out);
+		});
+	};
+
+	MeshFileType file_type = from_stdin ? MeshFileType::Obj : DetectMeshFileType(filename_in);
+
+	// The parsing runs on the same workers, so the two share the hardware threads.
+	ObjLoadOptions load_options;
+	load_options.queue = &build_queue;
+	load_options.on_shape = [&loaded_shapes, &build_mesh](tinyobj::shape_t&& shape)
+	{
+		loaded_shapes.push_back(std::move(shape));
+		build_mesh(loaded_shapes.back());
+	};
+	ObjCacheKey cache_key;
+	bool save_cache = false; // written once the loaded shapes are built
+	std::string filename_cache = std::string(filename_in) + ".cache";
+	if (use_cache && from_stdin)
+	{
+		fprintf(stderr, "--cache is ignored when reading stdin\n");
+		use_cache = false;
+	}
+	if (use_cache && file_type != MeshFileType::Obj)
+	{
+		// PLY and STL are read straight from their binary arrays.
+		use_cache = false;
+	}
+	if (use_cache)
+	{
+		use_cache = ComputeObjCacheKey(filename_in, load_options, &cache_key);
+	}
+
+	if (file_type != MeshFileType::Obj)
+	{
+		bool loaded;
+		if (file_type == MeshFileType::Ply)
+		{
+			loaded = LoadPlyMapped(&attrib, &shapes, &err, filename_in);
+		}
+		else
+		{
+			loaded = LoadStlMapped(&attrib, &shapes, &err, filename_in);
+		}
+		if (!loaded)
+		{
+			fprintf(stderr, "%s", err.c_str());
+			return 1;
+		}
+	}
+	else if (!use_cache || !LoadObjCache(filename_cache.c_str(), cache_key, &attrib, &shapes, &materials))
+	{
+		bool loaded;
+		if (from_stdin)
+		{
+			std::unique_ptr<BlockReader> reader = OpenBlockReader(stdin, "stdin", &err);
+			loaded = reader && LoadObjStream(&attrib, &shapes, &materials, &err, reader.get(), path_model.c_str(), load_options);
+		}
+		else
+		{
+			// Also fails when the file cannot be opened or its compression is not supported.
+			loaded = LoadObjFile(&attrib, &shapes, &materials, &err, filename_in, path_model.c_str(), load_options);
+		}
+		if (!loaded)
+		{
+			// Fail the pipeline rather than emit an empty or truncated model.
+			fprintf(stderr, "%s", err.c_str());
+			return 1;
+		}
+		save_cache = use_cache;
+	}
 
 	struct Img
 	{
 		std::string name;
-		int width, height, chn;
-		uint8_t* data = nullptr;
-
-		void Load(std::string filename, const std::string& path)
+		std::string filename;
+		int width = 0, height = 0, chn = 0;
+		uint8_t* data = nullptr; // in the channels of the file: grey, grey-alpha, RGB or RGBA
+
+		// How the output images use it, set before it is loaded.
+		bool as_is = false; // an output image of its own, unchanged
+		bool merged = false; // merged into an output image with another one
+
+		// Set when it is used as is and its file can be embedded, which then stays mapped.
+		std::shared_ptr<MappedFile> file;
+		const char* mime_type = nullptr;
+
+		// Reads the file from a mapping of it, and decodes it unless it is only embedded as is.
+		// Images are loaded on several threads at once, so this sets the stb flip flag of its own
+		// thread rather than rely on the global one.
+		void Load()
 		{
-			if (!exists_test(filename.c_str()))
+			std::shared_ptr<MappedFile> mapped = std::make_shared<MappedFile>();
+			if (!mapped->Open(filename.c_str()))
+			{
+				fprintf(stderr, "Cannot open texture %s\n", filename.c_str());
+				return;
+			}
+			if (mapped->size() > (size_t)INT_MAX)
+			{
+				// stb_image takes the size as an int.
+				fprintf(stderr, "Texture %s is too large to load\n", filename.c_str());
+				return;
+			}
+			const stbi_uc* bytes = (const stbi_uc*)mapped->data();
+			int size = (int)mapped->size();
+			if (as_is)
+			{
+				mime_type = EmbeddableMimeType(bytes, size, &width, &height, &chn);
+				if (mime_type != nullptr) file = mapped;
+			}
+			if (merged || file == nullptr)
 			{
-				filename = path + filename;
-			}			
-			data = stbi_load(filename.c_str(), &width, &height, &chn, 3);
+				stbi_set_flip_vertically_on_load_thread(0);
+				data = stbi_load_from_memory(bytes, size, &width, &height, &chn, 0);
+				if (data == nullptr) fprintf(stderr, "Cannot decode texture %s\n", filename.c_str());
+			}
 		}
 	};
 
 	std::vector<Img> textures_in;
 
+	// Source images by canonical path, so a file is decoded once however many material slots
+	// use it. They are only loaded once the output images are known, which tells how each one
+	// is used.
+	std::unordered_map<std::string, int> texture_in_map;
+	auto load_texture = [&textures_in, &texture_in_map, &path_model](const std::string& filename)
+	{
+		std::string path = filename;
+		if (!exists_test(path.c_str()))
+		{
+			path = path_model + filename;
+		}
+		std::error_code ec;
+		std::filesystem::path canonical = std::filesystem::weakly_canonical(std::filesystem::path(path), ec);
+		std::string key = ec ? path : canonical.u8string();
+		auto iter = texture_in_map.find(key);
+		if (iter != texture_in_map.end()) return iter->second;
+
+		char fn_tex[1024];
+		_splitpath(filename.c_str(), nullptr, nullptr, fn_tex, nullptr);
+		int idx_tex = (int)textures_in.size();
+		Img img;
+		img.name = fn_tex;
+		img.filename = path;
+		textures_in.push_back(img);
+		texture_in_map[key] = idx_tex;
+		return idx_tex;
+	};
+
 	struct MaterialIn
 	{
 		std::string name;
 		glm::vec3 color_diffuse = { 0.0f, 0.0f, 0.0f };
 		int idx_diffuse = -1;
 		glm::vec3 color_specular = { 0.0f, 0.0f, 0.0f };
-		int idx_specular = -1;
 		glm::vec3 color_emission = { 0.0f, 0.0f, 0.0f };		
 		int idx_emission = -1;
 		float shininess = 0.0f;		
@@ -92,33 +1137,12 @@ int main(int argc, char* argv[])
 
 			if (filename != "")
 			{
-				char fn_tex[1024];
-				_splitpath(filename.c_str(), nullptr, nullptr, fn_tex, nullptr);
-				int idx_tex = (int)textures_in.size();
-				Img img;
-				img.name = fn_tex;
-				img.Load(filename, path_model);
-				textures_in.push_back(img);
-				material_in.idx_diffuse = idx_tex;
+				material_in.idx_diffuse = load_texture(filename);
 			}
 		}
 
-		{
-			material_in.color_specular = { material.specular[0], material.specular[1], material.specular[2] };
-			std::string filename = materials[i].specular_texname;
-
-			if (filename != "")
-			{
-				char fn_tex[1024];
-				_splitpath(filename.c_str(), nullptr, nullptr, fn_tex, nullptr);
-				int idx_tex = (int)textures_in.size();
-				Img img;
-				img.name = fn_tex;
-				img.Load(filename, path_model);
-				textures_in.push_back(img);
-				material_in.idx_specular = idx_tex;
-			}
-		}
+		// A specular map has no glTF counterpart, so it is not loaded.
+		material_in.color_specular = { material.specular[0], material.specular[1], material.specular[2] };
 
 		{	
 			material_in.color_emission = { material.emission[0], material.emission[1], material.emission[2] };
@@ -126,14 +1150,7 @@ int main(int argc, char* argv[])
 
 			if (filename != "")
 			{
-				char fn_tex[1024];
-				_splitpath(filename.c_str(), nullptr, nullptr, fn_tex, nullptr);
-				int idx_tex = (int)textures_in.size();
-				Img img;
-				img.name = fn_tex;
-				img.Load(filename, path_model);
-				textures_in.push_back(img);
-				material_in.idx_emission = idx_tex;
+				material_in.idx_emission = load_texture(filename);
 			}
 		}
 		material_in.shininess = material.shininess;
@@ -142,14 +1159,7 @@ int main(int argc, char* argv[])
 			std::string filename = materials[i].alpha_texname;
 			if (filename != "")
 			{
-				char fn_tex[1024];
-				_splitpath(filename.c_str(), nullptr, nullptr, fn_tex, nullptr);
-				int idx_tex = (int)textures_in.size();
-				Img img;
-				img.name = fn_tex;
-				img.Load(filename, path_model);
-				textures_in.push_back(img);
-				material_in.idx_alpha = idx_tex;
+				material_in.idx_alpha = load_texture(filename);
 			}
 		}
 
@@ -157,30 +1167,92 @@ int main(int argc, char* argv[])
 			std::string filename = materials[i].bump_texname;
 			//std::string filename = materials[i].normal_texname;
 			if (filename != "")
-			{				
-				char fn_tex[1024];
-				_splitpath(filename.c_str(), nullptr, nullptr, fn_tex, nullptr);
-				int idx_tex = (int)textures_in.size();
-				Img img;
-				img.name = fn_tex;
-				img.Load(filename, path_model);
-				textures_in.push_back(img);
-				material_in.idx_normal = idx_tex;
+			{
+				material_in.idx_normal = load_texture(filename);
 			}
 		}	
 	}
 
+	// How an output image is made from the source images.
+	enum class TextureVariant
+	{
+		Color,		// the color image, as is when its file can be embedded, else as JPEG
+		ColorAlpha,	// the color image, grey or RGB, with the first channel of the alpha image as alpha, as PNG
+		Alpha		// white with the first channel of the alpha image as alpha, as a grey-alpha PNG
+	};
+
 	struct Image
 	{
 		std::string name;
 		std::string mimeType;
 		int width, height;
-		std::vector<unsigned char> data;
-		std::vector<unsigned char> storage;
+		int channels; // of the encoded file
+		TextureVariant variant;
+		const Img* color_in;
+		const Img* alpha_in;
+		std::vector<unsigned char> storage; // the encoded file
+		std::shared_ptr<MappedFile> file; // or the source file, embedded as is
 	};
 
 	std::vector<Image> textures;
 
+	// Makes the pixels of an output image from its sources and encodes them into its storage,
+	// unless it is its source file.
+	auto encode_image = [](Image* img)
+	{
+		const Img& img_in = img->color_in != nullptr ? *img->color_in : *img->alpha_in;
+		img->width = img_in.width;
+		img->height = img_in.height;
+		if (img->variant == TextureVariant::Color && img_in.file != nullptr)
+		{
+			img->mimeType = img_in.mime_type;
+			img->channels = img_in.chn;
+			img->file = img_in.file;
+			return;
+		}
+
+		size_t num_pixels = (size_t)img->width * (size_t)img->height;
+		auto write = [](void* context, void* data, int size)
+		{
+			std::vector<unsigned char>* buf = (std::vector<unsigned char>*)context;
+			buf->insert(buf->end(), (const unsigned char*)data, (const unsigned char*)data + size);
+		};
+		std::vector<unsigned char>& storage = img->storage;
+		if (img->variant == TextureVariant::Color)
+		{
+			// Written from the decoded channels. JPEG has no alpha, so it is dropped. The JPEG
+			// comes in many small pieces, so the buffer is sized ahead for a byte per pixel,
+			// more than quality 80 usually takes. stb always writes YCbCr, so it has 3 channels.
+			img->channels = 3;
+			storage.reserve(num_pixels);
+			stbi_write_jpg_to_func(write, &storage, img->width, img->height, img_in.chn, img_in.data, 80);
+			return;
+		}
+
+		// Only merged images are widened, to the color channels of the color image plus alpha.
+		const Img* color_in = img->color_in;
+		const Img* alpha_in = img->alpha_in;
+		int color_channels = color_in != nullptr && color_in->chn >= 3 ? 3 : 1;
+		int channels = color_channels + 1;
+		img->channels = channels;
+		std::vector<unsigned char> data(num_pixels * channels);
+		for (size_t pix_idx = 0; pix_idx < num_pixels; pix_idx++)
+		{
+			uint8_t* p_out = data.data() + pix_idx * channels;
+			if (color_in != nullptr)
+			{
+				const uint8_t* p_img = color_in->data + pix_idx * color_in->chn;
+				for (int c = 0; c < color_channels; c++) p_out[c] = p_img[c];
+			}
+			else
+			{
+				p_out[0] = 255;
+			}
+			p_out[color_channels] = alpha_in->data[pix_idx * alpha_in->chn];
+		}
+		stbi_write_png_to_func(write, &storage, img->width, img->height, channels, data.data(), img->width * channels);
+	};
+
 	struct Material
 	{
 		std::string name;
@@ -195,6 +1267,39 @@ int main(int argc, char* argv[])
 		int normalTex = -1;
 	};
 
+	// Output images by variant and sources, so materials making the same image share it.
+	std::map<std::tuple<TextureVariant, int, int>, int> texture_map;
+	auto get_texture = [&textures, &textures_in, &texture_map](TextureVariant variant, int idx_color, int idx_alpha)
+	{
+		auto key = std::make_tuple(variant, idx_color, idx_alpha);
+		auto iter = texture_map.find(key);
+		if (iter != texture_map.end()) return iter->second;
+
+		Img* color_in = idx_color >= 0 ? &textures_in[idx_color] : nullptr;
+		Img* alpha_in = idx_alpha >= 0 ? &textures_in[idx_alpha] : nullptr;
+		if (variant == TextureVariant::Color)
+		{
+			color_in->as_is = true;
+		}
+		else
+		{
+			if (color_in != nullptr) color_in->merged = true;
+			alpha_in->merged = true;
+		}
+
+		Image img_out;
+		img_out.name = color_in != nullptr ? color_in->name : alpha_in->name;
+		img_out.mimeType = variant == TextureVariant::Color ? "image/jpeg" : "image/png";
+		img_out.variant = variant;
+		img_out.color_in = color_in;
+		img_out.alpha_in = alpha_in;
+
+		int idx_tex = (int)textures.size();
+		textures.push_back(std::move(img_out));
+		texture_map[key] = idx_tex;
+		return idx_tex;
+	};
+
 	std::vector<Material> materials_mid(num_materials);
 	for (int i = 0; i < num_materials; i++)
 	{
@@ -231,258 +1336,210 @@ int main(int argc, char* argv[])
 		material_mid.roughnessFactor = r;
 
 		if (material_in.idx_diffuse >= 0)
-		{			
-			int idx_tex = (int)textures.size();
-			material_mid.baseColorTex = idx_tex;
-
-			Img& img_in = textures_in[material_in.idx_diffuse];
+		{
 			if (material_in.idx_alpha >= 0)
 			{
 				material_mid.blending = true;
-
-				Img& alpha_in = textures_in[material_in.idx_alpha];
-
-				Image img_out;
-				img_out.name = img_in.name;
-				img_out.width = img_in.width;
-				img_out.height = img_in.height;
-				img_out.mimeType = "image/png";
-				img_out.data.resize((size_t)img_out.width* (size_t)img_out.height * 4);
-
-				for (size_t pix_idx = 0; pix_idx < (size_t)img_out.width * (size_t)img_out.height; pix_idx++)
-				{
-					uint8_t* p_out = img_out.data.data() + pix_idx * 4;
-					const uint8_t* p_img = img_in.data + pix_idx * 3;
-					const uint8_t* p_alpha = alpha_in.data + pix_idx * 3;
-					p_out[0] = p_img[0]; p_out[1] = p_img[1]; p_out[2] = p_img[2];
-					p_out[3] = p_alpha[0];
-				}
-
-				textures.push_back(std::move(img_out));
+				material_mid.baseColorTex = get_texture(TextureVariant::ColorAlpha, material_in.idx_diffuse, material_in.idx_alpha);
 			}
 			else
 			{
-				Image img_out;
-				img_out.name = img_in.name;
-				img_out.width = img_in.width;
-				img_out.height = img_in.height;
-				img_out.mimeType = "image/jpeg";
-				img_out.data.resize((size_t)img_out.width * (size_t)img_out.height * 4);
-
-				for (size_t pix_idx = 0; pix_idx < (size_t)img_out.width * (size_t)img_out.height; pix_idx++)
-				{
-					uint8_t* p_out = img_out.data.data() + pix_idx * 4;
-					const uint8_t* p_img = img_in.data + pix_idx * 3;
-					p_out[0] = p_img[0]; p_out[1] = p_img[1]; p_out[2] = p_img[2];
-					p_out[3] = 255;
-				}
-
-				textures.push_back(std::move(img_out));
+				material_mid.baseColorTex = get_texture(TextureVariant::Color, material_in.idx_diffuse, -1);
 			}
 		}
 		else if (material_in.idx_alpha >= 0)
 		{
-			int idx_tex = (int)textures.size();
-			material_mid.baseColorTex = idx_tex;
-
 			material_mid.blending = true;
-			Img& alpha_in = textures_in[material_in.idx_alpha];
-
-			Image img_out;
-			img_out.name = alpha_in.name;
-			img_out.width = alpha_in.width;
-			img_out.height = alpha_in.height;
-			img_out.mimeType = "image/png";
-			img_out.data.resize((size_t)img_out.width * (size_t)img_out.height * 4);
-
-			for (size_t pix_idx = 0; pix_idx < (size_t)img_out.width * (size_t)img_out.height; pix_idx++)
-			{
-				uint8_t* p_out = img_out.data.data() + pix_idx * 4;
-				const uint8_t* p_alpha = alpha_in.data + pix_idx * 3;
-				p_out[0] = 255; p_out[1] = 255; p_out[2] = 255;
-				p_out[3] = p_alpha[0];
-			}
-
-			textures.push_back(std::move(img_out));
+			material_mid.baseColorTex = get_texture(TextureVariant::Alpha, -1, material_in.idx_alpha);
 		}
 
 		if (material_in.idx_emission >= 0)
 		{
-			int idx_tex = (int)textures.size();
-			material_mid.emissiveTex = idx_tex;
-
-			Img& img_in = textures_in[material_in.idx_emission];
-
-			Image img_out;
-			img_out.name = img_in.name;
-			img_out.width = img_in.width;
-			img_out.height = img_in.height;
-			img_out.mimeType = "image/jpeg";
-			img_out.data.resize((size_t)img_out.width * (size_t)img_out.height * 4);
-
-			for (size_t pix_idx = 0; pix_idx < (size_t)img_out.width * (size_t)img_out.height; pix_idx++)
-			{
-				uint8_t* p_out = img_out.data.data() + pix_idx * 4;
-				const uint8_t* p_img = img_in.data + pix_idx * 3;
-				p_out[0] = p_img[0]; p_out[1] = p_img[1]; p_out[2] = p_img[2];
-				p_out[3] = 255;
-			}
-
-			textures.push_back(std::move(img_out));
-			
+			material_mid.emissiveTex = get_texture(TextureVariant::Color, material_in.idx_emission, -1);
 		}
 
 		if (material_in.idx_normal >= 0)
 		{
-			int idx_tex = (int)textures.size();
-			material_mid.normalTex = idx_tex;
+			material_mid.normalTex = get_texture(TextureVariant::Color, material_in.idx_normal, -1);
+		}
+	}
+
+	// The images are decoded on the build queue, alongside the meshes still being built.
+	for (Img& img : textures_in)
+	{
+		Img* img_in = &img;
+		build_queue.Push([img_in]()
+		{
+			img_in->Load();
+		});
+	}
 
-			Img& img_in = textures_in[material_in.idx_normal];
+	// Shapes read from the cache or from PLY/STL were not built while loading.
+	for (const tinyobj::shape_t& shape : shapes)
+	{
+		build_mesh(shape);
+	}
+	build_queue.Wait();
+	int num_meshes = (int)meshes.size();
 
-			Image img_out;
-			img_out.name = img_in.name;
-			img_out.width = img_in.width;
-			img_out.height = img_in.height;
-			img_out.mimeType = "image/jpeg";
-			img_out.data.resize((size_t)img_out.width * (size_t)img_out.height * 4);
+	if (save_cache)
+	{
+		shapes.assign(std::make_move_iterator(loaded_shapes.begin()), std::make_move_iterator(loaded_shapes.end()));
+		SaveObjCache(filename_cache.c_str(), cache_key, attrib, shapes, materials);
+	}
+	std::deque<tinyobj::shape_t>().swap(loaded_shapes);
 
-			for (size_t pix_idx = 0; pix_idx < (size_t)img_out.width * (size_t)img_out.height; pix_idx++)
-			{
-				uint8_t* p_out = img_out.data.data() + pix_idx * 4;
-				const uint8_t* p_img = img_in.data + pix_idx * 3;
-				p_out[0] = p_img[0]; p_out[1] = p_img[1]; p_out[2] = p_img[2];
-				p_out[3] = 255;
-			}
-			textures.push_back(std::move(img_out));
+	// A color image is only merged with an alpha map that loaded at the same size. Otherwise the
+	// image falls back to the one that loaded, and the materials no longer blend without a mask.
+	for (Image& img : textures)
+	{
+		if (img.variant != TextureVariant::ColorAlpha) continue;
+		const Img* color_in = img.color_in;
+		const Img* alpha_in = img.alpha_in;
+		if (alpha_in->data == nullptr)
+		{
+			img.variant = TextureVariant::Color;
+			img.alpha_in = nullptr;
+		}
+		else if (color_in->data == nullptr)
+		{
+			img.variant = TextureVariant::Alpha;
+			img.name = alpha_in->name;
+			img.color_in = nullptr;
+		}
+		else if (alpha_in->width != color_in->width || alpha_in->height != color_in->height)
+		{
+			fprintf(stderr, "Alpha map %s is %dx%d, unlike %s at %dx%d, so it is ignored\n", alpha_in->name.c_str(),
+				alpha_in->width, alpha_in->height, color_in->name.c_str(), color_in->width, color_in->height);
+			img.variant = TextureVariant::Color;
+			img.alpha_in = nullptr;
 		}
+		if (img.variant == TextureVariant::Color) img.mimeType = "image/jpeg";
 	}
 
-	for (size_t i = 0; i < textures_in.size(); i++)
+	// Images left without a source that loaded are dropped, and so are the material slots using
+	// them. A color image can still be embedded from its file when it did not decode.
+	std::vector<int> texture_index(textures.size(), -1);
+	int num_kept = 0;
+	for (size_t i = 0; i < textures.size(); i++)
 	{
-		stbi_image_free(textures_in[i].data);
+		const Image& img = textures[i];
+		const Img& img_in = img.color_in != nullptr ? *img.color_in : *img.alpha_in;
+		bool embedded = img.variant == TextureVariant::Color && img_in.file != nullptr;
+		if (img_in.data == nullptr && !embedded) continue;
+		if (num_kept != (int)i) textures[num_kept] = std::move(textures[i]);
+		texture_index[i] = num_kept++;
 	}
+	textures.resize(num_kept);
 
-	struct Primitive
+	auto remap_texture = [&texture_index](int* idx_tex)
 	{
-		int material;
-		std::vector<glm::ivec3> indices;
-		std::vector<glm::vec3> positions;
-		std::vector<glm::vec3> normals;
-		std::vector<glm::vec3> colors;
-		std::vector<glm::vec2> texcoords;
-	};
-
-	struct Mesh
-	{		
-		std::string name;
-		std::vector<Primitive> primitives;
+		if (*idx_tex >= 0) *idx_tex = texture_index[*idx_tex];
 	};
+	for (Material& material_mid : materials_mid)
+	{
+		remap_texture(&material_mid.baseColorTex);
+		remap_texture(&material_mid.emissiveTex);
+		remap_texture(&material_mid.normalTex);
+		if (material_mid.blending && (material_mid.baseColorTex < 0 || textures[material_mid.baseColorTex].variant == TextureVariant::Color))
+		{
+			material_mid.blending = false;
+		}
+	}
 
-	int num_meshes = (int)shapes.size();
-	std::vector<Mesh> meshes(num_meshes);
-
-	for (int i = 0; i < num_meshes; i++)
-	{		
-		tinyobj::shape_t& shape = shapes[i];
-		Mesh& mesh_out = meshes[i];
-		mesh_out.name = shape.name;
+	// The output images are encoded on the build queue, alongside the geometry passes below.
+	// stb_image_write only reads its global settings, so they can be encoded concurrently.
+	for (Image& img : textures)
+	{
+		Image* img_out = &img;
+		build_queue.Push([encode_image, img_out]()
+		{
+			encode_image(img_out);
+		});
+	}
 
-		std::vector<Primitive>& primitives = mesh_out.primitives;
-		std::unordered_map<int, int> material_prim_map;
-				
-		for (size_t j = 0; j < shape.mesh.material_ids.size(); j++)
+	if (weld_tolerance.position > 0.0f)
+	{
+		for (Mesh& mesh : meshes)
 		{
-			int material_id = shape.mesh.material_ids[j];
-			auto iter = material_prim_map.find(material_id);
-			if (iter == material_prim_map.end())
+			if (mesh.shared_vertices)
 			{
-				int prim_id = (int)primitives.size();
-				primitives.resize(prim_id + 1);
-				Primitive& prim_out = primitives[prim_id];
-				prim_out.material = material_id;
-				material_prim_map[material_id] = prim_id;
+				Primitive* prim_weld = &mesh.shared;
+				build_queue.Push([&build_queue, &attrib, &weld_tolerance, prim_weld]()
+				{
+					GridWeldPrimitive(&build_queue, attrib, weld_tolerance, prim_weld);
+				});
+				continue;
 			}
-		}
-		
-		for (int i_prim = 0; i_prim < (int)primitives.size(); i_prim++)
-		{
-			Primitive& prim_out = primitives[i_prim];
-			int i_material = prim_out.material;			
-			std::unordered_map<uint64_t, size_t> ind_map;
-
-			for (int j = 0; j < (int)shape.mesh.material_ids.size(); j++)
-			{				
-				if (shape.mesh.material_ids[j] != i_material) continue;
-				
-				glm::ivec3 cur_ind;
-				for (int k = 0; k < 3; k++)
+			for (Primitive& prim : mesh.primitives)
+			{
+				Primitive* prim_weld = &prim;
+				build_queue.Push([&build_queue, &attrib, &weld_tolerance, prim_weld]()
 				{
-					int i_vertex = j * 3 + k;
-					tinyobj::index_t& index = shape.mesh.indices[i_vertex];
-
-					struct Attributes
-					{
-						glm::vec3 pos = { 0.0f, 0.0f, 0.0f };
-						glm::vec3 norm = { 0.0f, 0.0f, 0.0f };
-						glm::vec3 color = { 0.0f, 0.0f, 0.0f };
-						glm::vec2 uv = { 0.0f, 0.0f };
-					};
-
-					Attributes att;
-
-					float* vp = &attrib.vertices[3 * index.vertex_index];
-					att.pos = glm::vec3(vp[0], vp[1], vp[2]);
-						
-					if (attrib.normals.size() > 0)
-					{
-						float* np = &attrib.normals[3 * index.normal_index];
-						att.norm = glm::vec3(np[0], np[1], np[2]);
-					}
+					GridWeldPrimitive(&build_queue, attrib, weld_tolerance, prim_weld);
+				});
+			}
+		}
+		build_queue.Wait();
+	}
 
-					if (attrib.colors.size() > 0)
-					{
-						float* cp = &attrib.colors[3 * index.vertex_index];
-						att.color = glm::clamp(glm::vec3(cp[0], cp[1], cp[2]), 0.0f, 1.0f);
-					}
+	if (shared_vertices)
+	{
+		for (Mesh& mesh : meshes)
+		{
+			if (!mesh.shared_vertices) continue;
+			Mesh* mesh_split = &mesh;
+			build_queue.Push([mesh_split]()
+			{
+				SplitSharedFaces(mesh_split);
+			});
+		}
+		build_queue.Wait();
+	}
 
-					if (attrib.texcoords.size() > 0)
-					{
-						float* tp = &attrib.texcoords[2 * index.texcoord_index];
-						att.uv = glm::vec2(tp[0], 1.0f - tp[1]);
-					}
-						
-					int idx;
-					uint64_t hash = crc64(0, (unsigned char*)&att, sizeof(Attributes));
+	if (clean)
+	{
+		CleanupCounts counts;
+		for (Mesh& mesh : meshes)
+		{
+			for (Primitive& prim : mesh.primitives)
+			{
+				VertexPool* pool = &PoolOf(mesh, prim);
+				Primitive* prim_clean = &prim;
+				build_queue.Push([&build_queue, &attrib, min_area, &counts, pool, prim_clean]()
+				{
+					CleanupPrimitive(&build_queue, attrib, min_area, &counts, pool, prim_clean);
+				});
+			}
+		}
+		build_queue.Wait();
 
-					auto iter = ind_map.find(hash);
-					if (iter == ind_map.end())
-					{
-						idx = (int)prim_out.positions.size();
-						prim_out.positions.push_back(att.pos);
-						if (attrib.normals.size() > 0)
-						{
-							prim_out.normals.push_back(att.norm);
-						}
-						if (attrib.colors.size() > 0)
-						{
-							prim_out.colors.push_back(att.color);
-						}
-						if (attrib.texcoords.size() > 0)
-						{
-							prim_out.texcoords.push_back(att.uv);
-						}
-						ind_map[hash] = idx;
-					}
-					else
-					{
-						idx = ind_map[hash];
-					}
-					cur_ind[k] = idx;
+		for (Mesh& mesh : meshes)
+		{
+			if (!mesh.shared_vertices) continue;
+			Mesh* mesh_compact = &mesh;
+			build_queue.Push([mesh_compact]()
+			{
+				CompactVertices(&mesh_compact->shared.pool, mesh_compact->primitives.data(), mesh_compact->primitives.size());
+			});
+		}
+		build_queue.Wait();
 
-				}
-				prim_out.indices.push_back(cur_ind);
-			}
+		// Drops what is left empty, which glTF does not allow.
+		for (Mesh& mesh : meshes)
+		{
+			std::vector<Primitive>& primitives = mesh.primitives;
+			primitives.erase(std::remove_if(primitives.begin(), primitives.end(), [](const Primitive& prim)
+			{
+				return prim.indices.empty();
+			}), primitives.end());
 		}
+		meshes.erase(std::remove_if(meshes.begin(), meshes.end(), [](const Mesh& mesh)
+		{
+			return mesh.primitives.empty();
+		}), meshes.end());
+		num_meshes = (int)meshes.size();
+		fprintf(stderr, "Removed %zu degenerate and %zu duplicate triangles\n", counts.degenerate.load(), counts.duplicate.load());
 	}
 
 	//////////////////////////// Write GLTF //////////////////////////
@@ -514,6 +1571,24 @@ int main(int argc, char* argv[])
 	m_out.images.resize(num_textures);
 	m_out.textures.resize(num_textures);
 
+	// The images go first in the buffer, in order, each padded to 4 bytes.
+	build_queue.Wait();
+	for (size_t i = 0; i < textures_in.size(); i++)
+	{
+		stbi_image_free(textures_in[i].data);
+		textures_in[i].file.reset();
+	}
+
+	offset = 0;
+	for (int i = 0; i < num_textures; i++)
+	{
+		const Image& tex_in = textures[i];
+		length = tex_in.file != nullptr ? tex_in.file->size() : tex_in.storage.size();
+		offset += (length + 3) / 4 * 4;
+	}
+	buf_out.data.resize(offset);
+
+	offset = 0;
 	for (int i = 0; i < num_textures; i++)
 	{
 		Image& tex_in = textures[i];
@@ -523,50 +1598,22 @@ int main(int argc, char* argv[])
 		img_out.name = tex_in.name;
 		img_out.width = tex_in.width;
 		img_out.height = tex_in.height;
-		img_out.component = 4;
+		img_out.component = tex_in.channels;
 		img_out.bits = 8;
 		img_out.pixel_type = TINYGLTF_COMPONENT_TYPE_UNSIGNED_BYTE;
+		img_out.mimeType = tex_in.mimeType;
 
-		if (tex_in.mimeType == "image/png")
+		if (tex_in.file != nullptr)
 		{
-			img_out.mimeType = "image/png";
-
-			std::vector<unsigned char>& png_buf = tex_in.storage;
-			if (png_buf.size() == 0)
-			{
-				stbi_write_png_to_func([](void* context, void* data, int size)
-					{
-						std::vector<unsigned char>* buf = (std::vector<unsigned char>*)context;
-				size_t offset = buf->size();
-				buf->resize(offset + size);
-				memcpy(buf->data() + offset, data, size);
-					}, &png_buf, img_out.width, img_out.height, 4, tex_in.data.data(), img_out.width * 4);
-			}
-
-			offset = buf_out.data.size();
-			length = png_buf.size();
-			buf_out.data.resize((offset + length + 3) / 4 * 4);
-			memcpy(buf_out.data.data() + offset, png_buf.data(), length);
+			length = tex_in.file->size();
+			memcpy(buf_out.data.data() + offset, tex_in.file->data(), length);
+			tex_in.file.reset();
 		}
-		else if (tex_in.mimeType == "image/jpeg")
+		else
 		{
-			img_out.mimeType = "image/jpeg";
-
-			std::vector<unsigned char>& jpg_buf = tex_in.storage;
-			if (jpg_buf.size() == 0)
-			{
-				stbi_write_jpg_to_func([](void* context, void* data, int size)
-					{
-						std::vector<unsigned char>* buf = (std::vector<unsigned char>*)context;
-				size_t offset = buf->size();
-				buf->resize(offset + size);
-				memcpy(buf->data() + offset, data, size);
-					}, &jpg_buf, img_out.width, img_out.height, 4, tex_in.data.data(), 80);
-			}
-			offset = buf_out.data.size();
-			length = jpg_buf.size();
-			buf_out.data.resize((offset + length + 3) / 4 * 4);
-			memcpy(buf_out.data.data() + offset, jpg_buf.data(), length);
+			length = tex_in.storage.size();
+			memcpy(buf_out.data.data() + offset, tex_in.storage.data(), length);
+			std::vector<unsigned char>().swap(tex_in.storage);
 		}
 
 		view_id = m_out.bufferViews.size();
@@ -582,6 +1629,8 @@ int main(int argc, char* argv[])
 		tex_out.name = tex_in.name;
 		tex_out.sampler = 0;
 		tex_out.source = i;
+
+		offset += (length + 3) / 4 * 4;
 	}
 
 	// material	
@@ -620,15 +1669,80 @@ int main(int argc, char* argv[])
 		node_out.rotation = { 0.0, 0.0, 0.0, 1.0 };
 		node_out.scale = { 1.0, 1.0, 1.0 };
 		node_out.children.resize(num_meshes);
-		for (size_t i = 0; i < num_meshes; i++)
+		for (int i = 0; i < num_meshes; i++)
 		{
-			node_out.children[i] = (int)(i + 1);
+			node_out.children[i] = i + 1;
 		}
 
 	}
 	scene_out.nodes.push_back(0);
 
-	for (size_t i = 0; i < num_meshes; i++)
+	// The geometry goes after the textures, each primitive's indices followed by its vertices,
+	// or with shared vertices the indices of all of a mesh's primitives followed by its vertices.
+	// The buffer is sized once, then the primitives write into their place in parallel.
+	bool has_normals = attrib.normals.size() > 0;
+	bool has_colors = attrib.colors.size() > 0;
+	bool has_texcoords = attrib.texcoords.size() > 0;
+	auto lay_out_vertices = [has_normals, has_colors, has_texcoords, &offset](VertexPool& pool)
+	{
+		size_t num_pos = pool.vertices.size();
+		pool.offset_positions = offset;
+		offset += sizeof(glm::vec3) * num_pos;
+		if (has_normals)
+		{
+			pool.offset_normals = offset;
+			offset += sizeof(glm::vec3) * num_pos;
+		}
+		if (has_colors)
+		{
+			pool.offset_colors = offset;
+			offset += sizeof(glm::vec3) * num_pos;
+		}
+		if (has_texcoords)
+		{
+			pool.offset_texcoords = offset;
+			offset += sizeof(glm::vec2) * num_pos;
+		}
+	};
+	offset = buf_out.data.size();
+	for (Mesh& mesh : meshes)
+	{
+		for (Primitive& prim : mesh.primitives)
+		{
+			prim.offset_indices = offset;
+			offset += sizeof(glm::ivec3) * prim.indices.size();
+			if (!mesh.shared_vertices) lay_out_vertices(prim.pool);
+		}
+		if (mesh.shared_vertices) lay_out_vertices(mesh.shared.pool);
+	}
+	buf_out.data.resize(offset);
+
+	GatherFunc gather = SelectGather(attrib);
+	uint8_t* buffer = buf_out.data.data();
+	for (Mesh& mesh : meshes)
+	{
+		for (Primitive& prim : mesh.primitives)
+		{
+			Primitive* prim_in = &prim;
+			VertexPool* pool = mesh.shared_vertices ? nullptr : &prim.pool;
+			build_queue.Push([&attrib, gather, prim_in, pool, buffer]()
+			{
+				CopyIndices(prim_in, buffer);
+				if (pool != nullptr) gather(attrib, pool, buffer);
+			});
+		}
+		if (mesh.shared_vertices)
+		{
+			VertexPool* pool = &mesh.shared.pool;
+			build_queue.Push([&attrib, gather, pool, buffer]()
+			{
+				gather(attrib, pool, buffer);
+			});
+		}
+	}
+	build_queue.Wait();
+
+	for (int i = 0; i < num_meshes; i++)
 	{
 		Mesh& mesh_in = meshes[i];
 		tinygltf::Node& node_out = m_out.nodes[i+1];
@@ -644,6 +1758,10 @@ int main(int argc, char* argv[])
 		mesh_out.name = mesh_in.name;
 		mesh_out.primitives.resize(num_material);
 
+		// With shared vertices, the first primitive adds the index bufferView and the attributes
+		// for all of them.
+		size_t indices_view_id = 0;
+		std::map<std::string, int> attributes;
 		for (int j = 0; j < num_material; j++)
 		{
 			Primitive& prim_in = mesh_in.primitives[j];
@@ -651,58 +1769,59 @@ int main(int argc, char* argv[])
 			prim_out.material = prim_in.material;
 			prim_out.mode = TINYGLTF_MODE_TRIANGLES;
 
-			int num_pos = (int)prim_in.positions.size();
+			VertexPool& pool = PoolOf(mesh_in, prim_in);
+			int num_pos = (int)pool.vertices.size();
 			int num_face = (int)prim_in.indices.size();
+			bool first = j == 0 || !mesh_in.shared_vertices;
 
-			offset = buf_out.data.size();
-			length = sizeof(glm::ivec3) * num_face;
-			buf_out.data.resize(offset + length);
-			memcpy(buf_out.data.data() + offset, prim_in.indices.data(), length);
-
-			view_id = m_out.bufferViews.size();
+			if (first)
 			{
-				tinygltf::BufferView view;
-				view.buffer = 0;
-				view.byteOffset = offset;
-				view.byteLength = length;
-				view.target = TINYGLTF_TARGET_ELEMENT_ARRAY_BUFFER;
-				m_out.bufferViews.push_back(view);
+				offset = prim_in.offset_indices;
+				length = sizeof(glm::ivec3) * num_face;
+				if (mesh_in.shared_vertices)
+				{
+					const Primitive& last = mesh_in.primitives.back();
+					length = last.offset_indices + sizeof(glm::ivec3) * last.indices.size() - offset;
+				}
+
+				indices_view_id = m_out.bufferViews.size();
+				{
+					tinygltf::BufferView view;
+					view.buffer = 0;
+					view.byteOffset = offset;
+					view.byteLength = length;
+					view.target = TINYGLTF_TARGET_ELEMENT_ARRAY_BUFFER;
+					m_out.bufferViews.push_back(view);
+				}
 			}
 
 			acc_id = m_out.accessors.size();
 			{
 				tinygltf::Accessor acc;
-				acc.bufferView = view_id;
-				acc.byteOffset = 0;
+				acc.bufferView = indices_view_id;
+				acc.byteOffset = prim_in.offset_indices - m_out.bufferViews[indices_view_id].byteOffset;
 				acc.componentType = TINYGLTF_COMPONENT_TYPE_UNSIGNED_INT;
 				acc.count = (size_t)(num_face * 3);
 				acc.type = TINYGLTF_TYPE_SCALAR;
-				acc.maxValues = { (double)(num_pos - 1) };
-				acc.minValues = { 0 };
+				acc.maxValues = { (double)prim_in.max_index };
+				acc.minValues = { (double)prim_in.min_index };
 				m_out.accessors.push_back(acc);
 			}
 
 			prim_out.indices = acc_id;
 
-			glm::vec3 min_pos = { FLT_MAX, FLT_MAX, FLT_MAX };
-			glm::vec3 max_pos = { -FLT_MAX, -FLT_MAX, -FLT_MAX };
-
-			for (int k = 0; k < num_pos; k++)
+			if (!first)
 			{
-				glm::vec3 pos = prim_in.positions[k];
-				if (pos.x < min_pos.x) min_pos.x = pos.x;
-				if (pos.x > max_pos.x) max_pos.x = pos.x;
-				if (pos.y < min_pos.y) min_pos.y = pos.y;
-				if (pos.y > max_pos.y) max_pos.y = pos.y;
-				if (pos.z < min_pos.z) min_pos.z = pos.z;
-				if (pos.z > max_pos.z) max_pos.z = pos.z;
+				prim_out.attributes = attributes;
+				continue;
 			}
+			attributes.clear();
 
+			glm::vec3 min_pos = pool.min_pos;
+			glm::vec3 max_pos = pool.max_pos;
 
-			offset = buf_out.data.size();
+			offset = pool.offset_positions;
 			length = sizeof(glm::vec3) * num_pos;
-			buf_out.data.resize(offset + length);
-			memcpy(buf_out.data.data() + offset, prim_in.positions.data(), length);
 
 			view_id = m_out.bufferViews.size();
 			{
@@ -727,14 +1846,12 @@ int main(int argc, char* argv[])
 				m_out.accessors.push_back(acc);
 			}
 
-			prim_out.attributes["POSITION"] = acc_id;
+			attributes["POSITION"] = (int)acc_id;
 
-			if (prim_in.normals.size() > 0)
+			if (has_normals)
 			{
-				offset = buf_out.data.size();
+				offset = pool.offset_normals;
 				length = sizeof(glm::vec3) * num_pos;
-				buf_out.data.resize(offset + length);
-				memcpy(buf_out.data.data() + offset, prim_in.normals.data(), length);
 
 				view_id = m_out.bufferViews.size();
 				{
@@ -757,15 +1874,13 @@ int main(int argc, char* argv[])
 					m_out.accessors.push_back(acc);
 				}
 
-				prim_out.attributes["NORMAL"] = acc_id;
+				attributes["NORMAL"] = (int)acc_id;
 			}
 
-			if (prim_in.colors.size() > 0)
+			if (has_colors)
 			{
-				offset = buf_out.data.size();
+				offset = pool.offset_colors;
 				length = sizeof(glm::vec3) * num_pos;
-				buf_out.data.resize(offset + length);
-				memcpy(buf_out.data.data() + offset, prim_in.colors.data(), length);
 
 				view_id = m_out.bufferViews.size();
 				{
@@ -788,16 +1903,14 @@ int main(int argc, char* argv[])
 					m_out.accessors.push_back(acc);
 				}
 
-				prim_out.attributes["COLOR_0"] = acc_id;
+				attributes["COLOR_0"] = (int)acc_id;
 
 			}
 
-			if (prim_in.texcoords.size() > 0)
+			if (has_texcoords)
 			{
-				offset = buf_out.data.size();
+				offset = pool.offset_texcoords;
 				length = sizeof(glm::vec2) * num_pos;
-				buf_out.data.resize(offset + length);
-				memcpy(buf_out.data.data() + offset, prim_in.texcoords.data(), length);
 
 				view_id = m_out.bufferViews.size();
 				{
@@ -820,13 +1933,23 @@ int main(int argc, char* argv[])
 					m_out.accessors.push_back(acc);
 				}
 
-				prim_out.attributes["TEXCOORD_0"] = acc_id;
+				attributes["TEXCOORD_0"] = (int)acc_id;
 			}
+
+			prim_out.attributes = attributes;
 		}
 	}
 
 	tinygltf::TinyGLTF gltf;
-	gltf.WriteGltfSceneToFile(&m_out, argv[2], true, true, false, true);
+	if (to_stdout)
+	{
+		gltf.WriteGltfSceneToStream(&m_out, std::cout, false, true);
+		std::cout.flush();
+	}
+	else
+	{
+		gltf.WriteGltfSceneToFile(&m_out, filename_out, true, true, false, true);
+	}
 
 	return 0;
 }
@@ -0,0 +1,135 @@
+#include "mapped_file.h"
+
+#ifdef _WIN32
+#define WIN32_LEAN_AND_MEAN
+#define NOMINMAX
+#include <windows.h>
+#else
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+MappedFile::MappedFile()
+{
+
+}
+
+MappedFile::~MappedFile()
+{
+	Close();
+}
+
+#ifdef _WIN32
+
+bool MappedFile::Open(const char* filename, bool sequential)
+{
+	Close();
+
+	DWORD flags = FILE_ATTRIBUTE_NORMAL;
+	if (sequential) flags |= FILE_FLAG_SEQUENTIAL_SCAN;
+
+	HANDLE file = CreateFileA(filename, GENERIC_READ, FILE_SHARE_READ, nullptr, OPEN_EXISTING, flags, nullptr);
+	if (file == INVALID_HANDLE_VALUE) return false;
+	m_file = file;
+
+	LARGE_INTEGER size;
+	if (!GetFileSizeEx(file, &size))
+	{
+		Close();
+		return false;
+	}
+	m_size = (size_t)size.QuadPart;
+	if (m_size == 0) return true;
+
+	HANDLE mapping = CreateFileMappingA(file, nullptr, PAGE_READONLY, 0, 0, nullptr);
+	if (mapping == nullptr)
+	{
+		Close();
+		return false;
+	}
+	m_mapping = mapping;
+
+	m_data = (const char*)MapViewOfFile(mapping, FILE_MAP_READ, 0, 0, 0);
+	if (m_data == nullptr)
+	{
+		Close();
+		return false;
+	}
+
+	if (sequential)
+	{
+		WIN32_MEMORY_RANGE_ENTRY range;
+		range.VirtualAddress = (PVOID)m_data;
+		range.NumberOfBytes = m_size;
+		PrefetchVirtualMemory(GetCurrentProcess(), 1, &range, 0);
+	}
+	return true;
+}
+
+void MappedFile::Close()
+{
+	if (m_data != nullptr) UnmapViewOfFile(m_data);
+	if (m_mapping != nullptr) CloseHandle((HANDLE)m_mapping);
+	if (m_file != nullptr) CloseHandle((HANDLE)m_file);
+	m_data = nullptr;
+	m_mapping = nullptr;
+	m_file = nullptr;
+	m_size = 0;
+}
+
+#else
+
+bool MappedFile::Open(const char* filename, bool sequential)
+{
+	Close();
+
+	int fd = open(filename, O_RDONLY);
+	if (fd < 0) return false;
+
+	struct stat st;
+	if (fstat(fd, &st) != 0)
+	{
+		close(fd);
+		return false;
+	}
+	m_size = (size_t)st.st_size;
+	if (m_size == 0)
+	{
+		close(fd);
+		return true;
+	}
+
+#ifdef POSIX_FADV_SEQUENTIAL
+	if (sequential)
+	{
+		posix_fadvise(fd, 0, 0, POSIX_FADV_SEQUENTIAL);
+	}
+#endif
+
+	void* data = mmap(nullptr, m_size, PROT_READ, MAP_PRIVATE, fd, 0);
+	close(fd);
+	if (data == MAP_FAILED)
+	{
+		m_size = 0;
+		return false;
+	}
+	m_data = (const char*)data;
+
+	if (sequential)
+	{
+		madvise(data, m_size, MADV_SEQUENTIAL);
+		madvise(data, m_size, MADV_WILLNEED);
+	}
+	return true;
+}
+
+void MappedFile::Close()
+{
+	if (m_data != nullptr) munmap((void*)m_data, m_size);
+	m_data = nullptr;
+	m_size = 0;
+}
+
+#endif
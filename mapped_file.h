@@ -0,0 +1,33 @@
+#ifndef _mapped_file_h
+#define _mapped_file_h
+
+#include <cstddef>
+
+// Read-only memory mapping of a whole file.
+class MappedFile
+{
+public:
+	MappedFile();
+	~MappedFile();
+
+	MappedFile(const MappedFile&) = delete;
+	MappedFile& operator=(const MappedFile&) = delete;
+
+	// 'sequential' tells the OS the file will be read front to back, so it can read ahead
+	// aggressively and drop pages behind the reader.
+	bool Open(const char* filename, bool sequential = true);
+	void Close();
+
+	const char* data() const { return m_data; }
+	size_t size() const { return m_size; }
+
+private:
+	const char* m_data = nullptr;
+	size_t m_size = 0;
+#ifdef _WIN32
+	void* m_file = nullptr;
+	void* m_mapping = nullptr;
+#endif
+};
+
+#endif
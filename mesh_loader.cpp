@@ -0,0 +1,644 @@
+#include <cstdio>
+#include <cstring>
+#include <cmath>
+#include <filesystem>
+
+#include "mesh_loader.h"
+#include "mapped_file.h"
+#include "flat_index_map.h"
+
+using tinyobj::real_t;
+
+MeshFileType DetectMeshFileType(const char* filename)
+{
+	std::error_code ec;
+	uint64_t size = (uint64_t)std::filesystem::file_size(filename, ec);
+	if (ec) return MeshFileType::Obj;
+
+	FILE* file = fopen(filename, "rb");
+	if (file == nullptr) return MeshFileType::Obj;
+	unsigned char header[84];
+	size_t count = fread(header, 1, sizeof(header), file);
+	fclose(file);
+
+	if (count >= 4 && memcmp(header, "ply", 3) == 0 && (header[3] == '\n' || header[3] == '\r'))
+	{
+		return MeshFileType::Ply;
+	}
+	if (count == 84)
+	{
+		uint64_t num_triangles = (uint64_t)header[80] | ((uint64_t)header[81] << 8) | ((uint64_t)header[82] << 16) | ((uint64_t)header[83] << 24);
+		if (size == 84 + 50 * num_triangles) return MeshFileType::BinaryStl;
+	}
+	return MeshFileType::Obj;
+}
+
+static std::string ShapeName(const char* filename)
+{
+	return std::filesystem::path(filename).stem().u8string();
+}
+
+struct Vec3Key
+{
+	float v[3];
+};
+
+static bool HostIsLittleEndian()
+{
+	const uint16_t one = 1;
+	return *(const unsigned char*)&one == 1;
+}
+
+/////////////////////////////// PLY ///////////////////////////////
+
+enum class PlyType
+{
+	Invalid,
+	Int8,
+	UInt8,
+	Int16,
+	UInt16,
+	Int32,
+	UInt32,
+	Float32,
+	Float64
+};
+
+struct PlyProperty
+{
+	std::string name;
+	PlyType type = PlyType::Invalid;
+	bool is_list = false;
+	PlyType count_type = PlyType::Invalid;
+};
+
+struct PlyElement
+{
+	std::string name;
+	size_t count = 0;
+	std::vector<PlyProperty> properties;
+};
+
+static PlyType ParsePlyType(const std::string& name)
+{
+	if (name == "char" || name == "int8") return PlyType::Int8;
+	if (name == "uchar" || name == "uint8") return PlyType::UInt8;
+	if (name == "short" || name == "int16") return PlyType::Int16;
+	if (name == "ushort" || name == "uint16") return PlyType::UInt16;
+	if (name == "int" || name == "int32") return PlyType::Int32;
+	if (name == "uint" || name == "uint32") return PlyType::UInt32;
+	if (name == "float" || name == "float32") return PlyType::Float32;
+	if (name == "double" || name == "float64") return PlyType::Float64;
+	return PlyType::Invalid;
+}
+
+static size_t PlyTypeSize(PlyType type)
+{
+	switch (type)
+	{
+	case PlyType::Int8: case PlyType::UInt8: return 1;
+	case PlyType::Int16: case PlyType::UInt16: return 2;
+	case PlyType::Int32: case PlyType::UInt32: case PlyType::Float32: return 4;
+	case PlyType::Float64: return 8;
+	default: return 0;
+	}
+}
+
+template <typename T>
+static inline T LoadPly(const char* p, bool swap)
+{
+	unsigned char bytes[sizeof(T)];
+	memcpy(bytes, p, sizeof(T));
+	if (swap)
+	{
+		for (size_t i = 0; i < sizeof(T) / 2; i++) std::swap(bytes[i], bytes[sizeof(T) - 1 - i]);
+	}
+	T value;
+	memcpy(&value, bytes, sizeof(T));
+	return value;
+}
+
+static double ReadPlyValue(const char* p, PlyType type, bool swap)
+{
+	switch (type)
+	{
+	case PlyType::Int8: return (double)(int8_t)*p;
+	case PlyType::UInt8: return (double)(uint8_t)*p;
+	case PlyType::Int16: return (double)LoadPly<int16_t>(p, swap);
+	case PlyType::UInt16: return (double)LoadPly<uint16_t>(p, swap);
+	case PlyType::Int32: return (double)LoadPly<int32_t>(p, swap);
+	case PlyType::UInt32: return (double)LoadPly<uint32_t>(p, swap);
+	case PlyType::Float32: return (double)LoadPly<float>(p, swap);
+	case PlyType::Float64: return LoadPly<double>(p, swap);
+	default: return 0.0;
+	}
+}
+
+static inline float ReadPlyFloat(const char* p, PlyType type, bool swap)
+{
+	if (type == PlyType::Float32 && !swap)
+	{
+		float value;
+		memcpy(&value, p, 4);
+		return value;
+	}
+	return (float)ReadPlyValue(p, type, swap);
+}
+
+static inline int64_t ReadPlyInt(const char* p, PlyType type, bool swap)
+{
+	if (type == PlyType::Int32 && !swap)
+	{
+		int32_t value;
+		memcpy(&value, p, 4);
+		return value;
+	}
+	return (int64_t)ReadPlyValue(p, type, swap);
+}
+
+// Parses the header up to "end_header". Returns the start of the binary data, or nullptr.
+static const char* ParsePlyHeader(const char* data, const char* end, bool* little_endian,
+	std::vector<PlyElement>* elements, std::string* err)
+{
+	const char* p = data;
+	bool has_format = false;
+	while (p < end)
+	{
+		const char* line_end = (const char*)memchr(p, '\n', end - p);
+		if (line_end == nullptr) break;
+		std::string line(p, line_end);
+		p = line_end + 1;
+		if (!line.empty() && line.back() == '\r') line.pop_back();
+
+		char word[64] = "";
+		sscanf(line.c_str(), "%63s", word);
+		std::string keyword = word;
+
+		if (keyword == "format")
+		{
+			char format[64] = "";
+			sscanf(line.c_str(), "%*s %63s", format);
+			if (strcmp(format, "binary_little_endian") == 0) *little_endian = true;
+			else if (strcmp(format, "binary_big_endian") == 0) *little_endian = false;
+			else
+			{
+				if (err) (*err) = std::string("Unsupported PLY format [") + format + "], only binary PLY can be read\n";
+				return nullptr;
+			}
+			has_format = true;
+		}
+		else if (keyword == "element")
+		{
+			char name[256] = "";
+			unsigned long long count = 0;
+			if (sscanf(line.c_str(), "%*s %255s %llu", name, &count) != 2)
+			{
+				if (err) (*err) = "Invalid PLY element [" + line + "]\n";
+				return nullptr;
+			}
+			PlyElement element;
+			element.name = name;
+			element.count = (size_t)count;
+			elements->push_back(element);
+		}
+		else if (keyword == "property")
+		{
+			char type[64] = "", count_type[64] = "", item_type[64] = "", name[256] = "";
+			PlyProperty property;
+			if (sscanf(line.c_str(), "%*s %63s", type) == 1 && strcmp(type, "list") == 0)
+			{
+				sscanf(line.c_str(), "%*s %*s %63s %63s %255s", count_type, item_type, name);
+				property.is_list = true;
+				property.count_type = ParsePlyType(count_type);
+				property.type = ParsePlyType(item_type);
+				if (property.count_type == PlyType::Invalid) property.type = PlyType::Invalid;
+			}
+			else
+			{
+				sscanf(line.c_str(), "%*s %*s %255s", name);
+				property.type = ParsePlyType(type);
+			}
+			property.name = name;
+			if (elements->empty() || property.type == PlyType::Invalid || property.name.empty())
+			{
+				if (err) (*err) = "Invalid PLY property [" + line + "]\n";
+				return nullptr;
+			}
+			elements->back().properties.push_back(property);
+		}
+		else if (keyword == "end_header")
+		{
+			if (!has_format)
+			{
+				if (err) (*err) = "PLY header without format\n";
+				return nullptr;
+			}
+			return p;
+		}
+		// "ply", "comment" and "obj_info" lines are ignored.
+	}
+
+	if (err) (*err) = "PLY header without end_header\n";
+	return nullptr;
+}
+
+// Walks one property of a record. Returns false past 'end'.
+static bool SkipPlyProperty(const char** p, const char* end, const PlyProperty& property, bool swap)
+{
+	const char* q = *p;
+	size_t size = PlyTypeSize(property.type);
+	if (property.is_list)
+	{
+		size_t count_size = PlyTypeSize(property.count_type);
+		if ((size_t)(end - q) < count_size) return false;
+		int64_t count = ReadPlyInt(q, property.count_type, swap);
+		q += count_size;
+		if (count < 0 || (uint64_t)count > (uint64_t)(end - q) / size) return false;
+		size *= (size_t)count;
+	}
+	if ((size_t)(end - q) < size) return false;
+	*p = q + size;
+	return true;
+}
+
+// Walks one record of an element that has list properties. Returns false past 'end'.
+static bool SkipPlyRecord(const char** p, const char* end, const PlyElement& element, bool swap)
+{
+	for (const PlyProperty& property : element.properties)
+	{
+		if (!SkipPlyProperty(p, end, property, swap)) return false;
+	}
+	return true;
+}
+
+// Size of a record without list properties, 0 if it has any.
+static size_t PlyRecordSize(const PlyElement& element)
+{
+	size_t size = 0;
+	for (const PlyProperty& property : element.properties)
+	{
+		if (property.is_list) return 0;
+		size += PlyTypeSize(property.type);
+	}
+	return size;
+}
+
+struct PlyField
+{
+	size_t offset = 0;
+	PlyType type = PlyType::Invalid;
+};
+
+static bool FindPlyField(const PlyElement& element, const char* const* names, PlyField* field)
+{
+	for (; *names != nullptr; names++)
+	{
+		size_t offset = 0;
+		for (const PlyProperty& property : element.properties)
+		{
+			if (property.name == *names)
+			{
+				field->offset = offset;
+				field->type = property.type;
+				return true;
+			}
+			offset += PlyTypeSize(property.type);
+		}
+	}
+	return false;
+}
+
+static bool FindPlyFields(const PlyElement& element, const char* const* names[], int count, PlyField* fields)
+{
+	for (int i = 0; i < count; i++)
+	{
+		if (!FindPlyField(element, names[i], &fields[i])) return false;
+	}
+	return true;
+}
+
+static bool ReadPlyVertices(const char** p, const char* end, const PlyElement& element, bool swap,
+	tinyobj::attrib_t* attrib, std::string* err)
+{
+	size_t stride = PlyRecordSize(element);
+	if (stride == 0)
+	{
+		if (err) (*err) = "PLY vertices with list properties are not supported\n";
+		return false;
+	}
+	size_t count = element.count;
+	if ((size_t)(end - *p) / stride < count)
+	{
+		if (err) (*err) = "Unexpected end of PLY vertex data\n";
+		return false;
+	}
+
+	static const char* const x[] = { "x", nullptr };
+	static const char* const y[] = { "y", nullptr };
+	static const char* const z[] = { "z", nullptr };
+	static const char* const nx[] = { "nx", "normal_x", nullptr };
+	static const char* const ny[] = { "ny", "normal_y", nullptr };
+	static const char* const nz[] = { "nz", "normal_z", nullptr };
+	static const char* const red[] = { "red", "r", "diffuse_red", nullptr };
+	static const char* const green[] = { "green", "g", "diffuse_green", nullptr };
+	static const char* const blue[] = { "blue", "b", "diffuse_blue", nullptr };
+	static const char* const u[] = { "u", "s", "texture_u", "texture_s", nullptr };
+	static const char* const v[] = { "v", "t", "texture_v", "texture_t", nullptr };
+
+	static const char* const* position_names[] = { x, y, z };
+	static const char* const* normal_names[] = { nx, ny, nz };
+	static const char* const* color_names[] = { red, green, blue };
+	static const char* const* texcoord_names[] = { u, v };
+
+	PlyField position[3], normal[3], color[3], texcoord[2];
+	if (!FindPlyFields(element, position_names, 3, position))
+	{
+		if (err) (*err) = "PLY vertices without x, y, z\n";
+		return false;
+	}
+	bool has_normals = FindPlyFields(element, normal_names, 3, normal);
+	bool has_colors = FindPlyFields(element, color_names, 3, color);
+	bool has_texcoords = FindPlyFields(element, texcoord_names, 2, texcoord);
+
+	// Integer colors are 0..255, floating point ones 0..1.
+	float color_range[3];
+	for (int k = 0; k < 3; k++)
+	{
+		bool is_float = color[k].type == PlyType::Float32 || color[k].type == PlyType::Float64;
+		color_range[k] = is_float ? 1.0f : 255.0f;
+	}
+
+	attrib->vertices.resize(count * 3);
+	if (has_normals) attrib->normals.resize(count * 3);
+	if (has_colors) attrib->colors.resize(count * 3);
+	if (has_texcoords) attrib->texcoords.resize(count * 2);
+
+	const char* record = *p;
+	for (size_t i = 0; i < count; i++, record += stride)
+	{
+		for (int k = 0; k < 3; k++)
+		{
+			attrib->vertices[i * 3 + k] = ReadPlyFloat(record + position[k].offset, position[k].type, swap);
+		}
+		if (has_normals)
+		{
+			for (int k = 0; k < 3; k++)
+			{
+				attrib->normals[i * 3 + k] = ReadPlyFloat(record + normal[k].offset, normal[k].type, swap);
+			}
+		}
+		if (has_colors)
+		{
+			for (int k = 0; k < 3; k++)
+			{
+				attrib->colors[i * 3 + k] = ReadPlyFloat(record + color[k].offset, color[k].type, swap) / color_range[k];
+			}
+		}
+		if (has_texcoords)
+		{
+			for (int k = 0; k < 2; k++)
+			{
+				attrib->texcoords[i * 2 + k] = ReadPlyFloat(record + texcoord[k].offset, texcoord[k].type, swap);
+			}
+		}
+	}
+	*p = record;
+	return true;
+}
+
+static bool ReadPlyFaces(const char** p, const char* end, const PlyElement& element, bool swap,
+	size_t num_vertices, bool has_normals, bool has_texcoords, tinyobj::mesh_t* mesh, std::string* err)
+{
+	int list = -1;
+	for (size_t i = 0; i < element.properties.size(); i++)
+	{
+		const PlyProperty& property = element.properties[i];
+		if (property.is_list && (property.name == "vertex_indices" || property.name == "vertex_index"))
+		{
+			list = (int)i;
+			break;
+		}
+	}
+	if (list < 0)
+	{
+		if (err) (*err) = "PLY faces without vertex_indices\n";
+		return false;
+	}
+	const PlyProperty& indices = element.properties[list];
+	size_t count_size = PlyTypeSize(indices.count_type);
+	size_t index_size = PlyTypeSize(indices.type);
+
+	mesh->indices.reserve(element.count * 3);
+	mesh->num_face_vertices.reserve(element.count);
+
+	tinyobj::index_t corner;
+	std::vector<int> polygon;
+	const char* q = *p;
+	for (size_t i = 0; i < element.count; i++)
+	{
+		const char* record = q;
+		if (!SkipPlyRecord(&q, end, element, swap))
+		{
+			if (err) (*err) = "Unexpected end of PLY face data\n";
+			return false;
+		}
+
+		// The vertex list, past the properties before it. The record is known to be complete.
+		const char* r = record;
+		for (int j = 0; j < list; j++)
+		{
+			SkipPlyProperty(&r, end, element.properties[j], swap);
+		}
+		int64_t num_corners = ReadPlyInt(r, indices.count_type, swap);
+		r += count_size;
+
+		polygon.resize((size_t)num_corners);
+		for (int64_t k = 0; k < num_corners; k++, r += index_size)
+		{
+			int64_t index = ReadPlyInt(r, indices.type, swap);
+			if (index < 0 || (uint64_t)index >= num_vertices)
+			{
+				if (err) (*err) = "PLY face " + std::to_string(i) + " has a vertex index out of range\n";
+				return false;
+			}
+			polygon[(size_t)k] = (int)index;
+		}
+
+		for (int64_t k = 2; k < num_corners; k++)
+		{
+			const int tri[3] = { polygon[0], polygon[(size_t)k - 1], polygon[(size_t)k] };
+			for (int c = 0; c < 3; c++)
+			{
+				corner.vertex_index = tri[c];
+				corner.normal_index = has_normals ? tri[c] : -1;
+				corner.texcoord_index = has_texcoords ? tri[c] : -1;
+				mesh->indices.push_back(corner);
+			}
+			mesh->num_face_vertices.push_back(3);
+		}
+	}
+	mesh->material_ids.assign(mesh->num_face_vertices.size(), -1);
+	*p = q;
+	return true;
+}
+
+bool LoadPlyMapped(tinyobj::attrib_t* attrib, std::vector<tinyobj::shape_t>* shapes, std::string* err,
+	const char* filename)
+{
+	attrib->vertices.clear();
+	attrib->normals.clear();
+	attrib->texcoords.clear();
+	attrib->colors.clear();
+	shapes->clear();
+
+	MappedFile file;
+	if (!file.Open(filename))
+	{
+		if (err) (*err) = std::string("Cannot open file [") + filename + "]\n";
+		return false;
+	}
+	const char* end = file.data() + file.size();
+
+	bool little_endian = true;
+	std::vector<PlyElement> elements;
+	const char* p = ParsePlyHeader(file.data(), end, &little_endian, &elements, err);
+	if (p == nullptr) return false;
+	bool swap = little_endian != HostIsLittleEndian();
+
+	tinyobj::shape_t shape;
+	shape.name = ShapeName(filename);
+	bool has_vertices = false;
+	for (const PlyElement& element : elements)
+	{
+		if (element.name == "vertex" && !has_vertices)
+		{
+			if (!ReadPlyVertices(&p, end, element, swap, attrib, err)) return false;
+			has_vertices = true;
+		}
+		else if (element.name == "face" && has_vertices && shape.mesh.indices.empty())
+		{
+			if (!ReadPlyFaces(&p, end, element, swap, attrib->vertices.size() / 3,
+				!attrib->normals.empty(), !attrib->texcoords.empty(), &shape.mesh, err)) return false;
+		}
+		else
+		{
+			size_t stride = PlyRecordSize(element);
+			if (stride != 0)
+			{
+				if ((size_t)(end - p) / stride < element.count)
+				{
+					if (err) (*err) = "Unexpected end of PLY data\n";
+					return false;
+				}
+				p += stride * element.count;
+			}
+			else
+			{
+				for (size_t i = 0; i < element.count; i++)
+				{
+					if (!SkipPlyRecord(&p, end, element, swap))
+					{
+						if (err) (*err) = "Unexpected end of PLY data\n";
+						return false;
+					}
+				}
+			}
+		}
+	}
+
+	if (shape.mesh.indices.size() > 0)
+	{
+		shapes->push_back(std::move(shape));
+	}
+	return true;
+}
+
+/////////////////////////////// STL ///////////////////////////////
+
+bool LoadStlMapped(tinyobj::attrib_t* attrib, std::vector<tinyobj::shape_t>* shapes, std::string* err,
+	const char* filename)
+{
+	attrib->vertices.clear();
+	attrib->normals.clear();
+	attrib->texcoords.clear();
+	attrib->colors.clear();
+	shapes->clear();
+
+	MappedFile file;
+	if (!file.Open(filename))
+	{
+		if (err) (*err) = std::string("Cannot open file [") + filename + "]\n";
+		return false;
+	}
+	const char* data = file.data();
+	uint32_t num_triangles = 0;
+	if (file.size() >= 84) num_triangles = LoadPly<uint32_t>(data + 80, !HostIsLittleEndian());
+	if (file.size() < 84 || (file.size() - 84) / 50 < num_triangles)
+	{
+		if (err) (*err) = std::string("Invalid binary STL file [") + filename + "]\n";
+		return false;
+	}
+	bool swap = !HostIsLittleEndian();
+
+	tinyobj::shape_t shape;
+	shape.name = ShapeName(filename);
+	tinyobj::mesh_t& mesh = shape.mesh;
+	mesh.indices.resize((size_t)num_triangles * 3);
+	mesh.num_face_vertices.assign(num_triangles, 3);
+	mesh.material_ids.assign(num_triangles, -1);
+
+	// Corners and normals that are bitwise equal share an index, so that the index-based
+	// welding in the converter joins them.
+	FlatIndexMap<Vec3Key> positions(num_triangles);
+	FlatIndexMap<Vec3Key> normals(num_triangles);
+	attrib->vertices.reserve((size_t)num_triangles * 3);
+
+	const char* record = data + 84;
+	for (size_t i = 0; i < num_triangles; i++, record += 50)
+	{
+		// normal, 3 corners, 2 bytes of attributes
+		Vec3Key values[4];
+		for (int k = 0; k < 12; k++)
+		{
+			values[k / 3].v[k % 3] = LoadPly<float>(record + k * 4, swap);
+		}
+
+		Vec3Key& normal = values[0];
+		if (normal.v[0] == 0.0f && normal.v[1] == 0.0f && normal.v[2] == 0.0f)
+		{
+			const float* p0 = values[1].v;
+			const float* p1 = values[2].v;
+			const float* p2 = values[3].v;
+			float e1[3], e2[3];
+			for (int k = 0; k < 3; k++)
+			{
+				e1[k] = p1[k] - p0[k];
+				e2[k] = p2[k] - p0[k];
+			}
+			float n[3] = { e1[1] * e2[2] - e1[2] * e2[1], e1[2] * e2[0] - e1[0] * e2[2], e1[0] * e2[1] - e1[1] * e2[0] };
+			float length = sqrtf(n[0] * n[0] + n[1] * n[1] + n[2] * n[2]);
+			float scale = length > 0.0f ? 1.0f / length : 0.0f;
+			for (int k = 0; k < 3; k++) normal.v[k] = n[k] * scale;
+		}
+
+		bool inserted;
+		int normal_index = normals.Insert(normal, &inserted);
+		if (inserted) attrib->normals.insert(attrib->normals.end(), normal.v, normal.v + 3);
+
+		for (int c = 0; c < 3; c++)
+		{
+			const Vec3Key& position = values[1 + c];
+			tinyobj::index_t& corner = mesh.indices[i * 3 + c];
+			corner.vertex_index = positions.Insert(position, &inserted);
+			corner.normal_index = normal_index;
+			corner.texcoord_index = -1;
+			if (inserted) attrib->vertices.insert(attrib->vertices.end(), position.v, position.v + 3);
+		}
+	}
+
+	if (num_triangles > 0)
+	{
+		shapes->push_back(std::move(shape));
+	}
+	return true;
+}
@@ -0,0 +1,30 @@
+#ifndef _mesh_loader_h
+#define _mesh_loader_h
+
+#include "tiny_obj_loader.h"
+
+enum class MeshFileType
+{
+	Obj,	// anything that is not recognized as one of the others
+	Ply,
+	BinaryStl
+};
+
+// Recognizes PLY files by their "ply" signature, and binary STL files by their size matching the
+// triangle count in their header (the 80-byte header itself may well start with "solid").
+MeshFileType DetectMeshFileType(const char* filename);
+
+// Loaders for binary scan formats. The file is memory mapped and its arrays are converted
+// straight into a single shape, named after the file, without material (-1). Per-vertex normals,
+// colors and texture coordinates go to the attrib arrays with the same index as the position.
+// Polygons are triangulated as fans.
+// Only binary PLY (both byte orders) is read; ASCII PLY is reported as an error.
+bool LoadPlyMapped(tinyobj::attrib_t* attrib, std::vector<tinyobj::shape_t>* shapes, std::string* err,
+	const char* filename);
+
+// STL stores each triangle with its own 3 corners and a face normal, which becomes the normal of
+// all 3 corners. A zero normal, as many exporters write, is replaced by the geometric one.
+bool LoadStlMapped(tinyobj::attrib_t* attrib, std::vector<tinyobj::shape_t>* shapes, std::string* err,
+	const char* filename);
+
+#endif
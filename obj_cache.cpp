@@ -0,0 +1,397 @@
+#include <cstdio>
+#include <cstring>
+#include <filesystem>
+
+#include "obj_cache.h"
+#include "mapped_file.h"
+#include "crc64.h"
+
+using tinyobj::real_t;
+
+static const char s_magic[8] = { 'O', 'B', 'J', 'C', 'A', 'C', 'H', 'E' };
+static const char s_end_magic[8] = { 'E', 'N', 'D', 'C', 'A', 'C', 'H', 'E' };
+static const uint32_t s_version = 2;
+
+bool ComputeObjCacheKey(const char* filename, const ObjLoadOptions& options, ObjCacheKey* key)
+{
+	std::error_code ec;
+	std::filesystem::file_time_type mtime = std::filesystem::last_write_time(filename, ec);
+	if (ec) return false;
+
+	MappedFile file;
+	if (!file.Open(filename)) return false;
+
+	key->size = file.size();
+	key->mtime = (int64_t)mtime.time_since_epoch().count();
+	key->hash = crc64(0, (const unsigned char*)file.data(), file.size());
+	key->triangulate = options.triangulate;
+	return true;
+}
+
+// Writes the cache sequentially. Arrays start at 8-byte aligned offsets.
+class CacheWriter
+{
+public:
+	explicit CacheWriter(FILE* file) : m_file(file) {}
+
+	bool ok() const { return m_ok; }
+
+	void Bytes(const void* data, size_t size)
+	{
+		if (size > 0 && fwrite(data, 1, size, m_file) != size) m_ok = false;
+		m_pos += size;
+	}
+
+	template <typename T>
+	void Value(const T& v)
+	{
+		Bytes(&v, sizeof(T));
+	}
+
+	void Bool(const bool& v)
+	{
+		uint8_t b = v ? 1 : 0;
+		Value(b);
+	}
+
+	void String(const std::string& s)
+	{
+		Value((uint64_t)s.size());
+		Bytes(s.data(), s.size());
+	}
+
+	template <typename T>
+	void Array(const std::vector<T>& arr)
+	{
+		static const char zeros[8] = { 0 };
+		Value((uint64_t)arr.size());
+		Bytes(zeros, (8 - m_pos % 8) % 8);
+		Bytes(arr.data(), arr.size() * sizeof(T));
+	}
+
+	size_t Count(size_t count)
+	{
+		Value((uint64_t)count);
+		return count;
+	}
+
+	template <typename T>
+	void Resize(const std::vector<T>&, size_t) {}
+
+	void StringMap(const std::map<std::string, std::string>& map)
+	{
+		Count(map.size());
+		for (auto iter = map.begin(); iter != map.end(); iter++)
+		{
+			String(iter->first);
+			String(iter->second);
+		}
+	}
+
+private:
+	FILE* m_file;
+	uint64_t m_pos = 0;
+	bool m_ok = true;
+};
+
+// Reads the cache out of a mapping, failing instead of reading past its end.
+class CacheReader
+{
+public:
+	CacheReader(const char* data, size_t size) : m_begin(data), m_pos(data), m_end(data + size) {}
+
+	bool ok() const { return m_ok; }
+
+	void Bytes(void* data, size_t size)
+	{
+		if (!Need(size))
+		{
+			memset(data, 0, size);
+			return;
+		}
+		memcpy(data, m_pos, size);
+		m_pos += size;
+	}
+
+	template <typename T>
+	void Value(T& v)
+	{
+		Bytes(&v, sizeof(T));
+	}
+
+	void Bool(bool& v)
+	{
+		uint8_t b;
+		Value(b);
+		v = b != 0;
+	}
+
+	void String(std::string& s)
+	{
+		uint64_t size;
+		Value(size);
+		if (!Need(size)) return;
+		s.assign(m_pos, (size_t)size);
+		m_pos += size;
+	}
+
+	template <typename T>
+	void Array(std::vector<T>& arr)
+	{
+		uint64_t count;
+		Value(count);
+		size_t pad = (8 - (size_t)(m_pos - m_begin) % 8) % 8;
+		if (!Need(pad)) return;
+		m_pos += pad;
+		if (count > (uint64_t)(m_end - m_pos) / sizeof(T))
+		{
+			m_ok = false;
+			return;
+		}
+		arr.resize((size_t)count);
+		Bytes(arr.data(), arr.size() * sizeof(T));
+	}
+
+	// Number of elements that follow. Each takes at least one byte, which bounds the count.
+	size_t Count(size_t)
+	{
+		uint64_t count;
+		Value(count);
+		if (count > (uint64_t)(m_end - m_pos))
+		{
+			m_ok = false;
+			return 0;
+		}
+		return (size_t)count;
+	}
+
+	template <typename T>
+	void Resize(std::vector<T>& arr, size_t count)
+	{
+		arr.resize(count);
+	}
+
+	void StringMap(std::map<std::string, std::string>& map)
+	{
+		size_t count = Count(0);
+		for (size_t i = 0; i < count && m_ok; i++)
+		{
+			std::string name;
+			String(name);
+			String(map[name]);
+		}
+	}
+
+private:
+	bool Need(uint64_t size)
+	{
+		if (m_ok && size <= (uint64_t)(m_end - m_pos)) return true;
+		m_ok = false;
+		return false;
+	}
+
+	const char* m_begin;
+	const char* m_pos;
+	const char* m_end;
+	bool m_ok = true;
+};
+
+// The layout is described once for both directions. 'Archive' is CacheWriter or CacheReader, with
+// the structs const for writing.
+
+template <typename Archive, typename Vector, typename Func>
+static void SerializeEach(Archive& ar, Vector& vec, Func func)
+{
+	ar.Resize(vec, ar.Count(vec.size()));
+	for (size_t i = 0; i < vec.size() && ar.ok(); i++)
+	{
+		func(vec[i]);
+	}
+}
+
+template <typename Archive, typename TextureOption>
+static void SerializeTextureOption(Archive& ar, TextureOption& opt)
+{
+	ar.Value(opt.type);
+	ar.Value(opt.sharpness);
+	ar.Value(opt.brightness);
+	ar.Value(opt.contrast);
+	ar.Value(opt.origin_offset);
+	ar.Value(opt.scale);
+	ar.Value(opt.turbulence);
+	ar.Bool(opt.clamp);
+	ar.Value(opt.imfchan);
+	ar.Bool(opt.blendu);
+	ar.Bool(opt.blendv);
+	ar.Value(opt.bump_multiplier);
+}
+
+template <typename Archive, typename Material>
+static void SerializeMaterial(Archive& ar, Material& material)
+{
+	ar.String(material.name);
+	ar.Value(material.ambient);
+	ar.Value(material.diffuse);
+	ar.Value(material.specular);
+	ar.Value(material.transmittance);
+	ar.Value(material.emission);
+	ar.Value(material.shininess);
+	ar.Value(material.ior);
+	ar.Value(material.dissolve);
+	ar.Value(material.illum);
+
+	ar.String(material.ambient_texname);
+	ar.String(material.diffuse_texname);
+	ar.String(material.specular_texname);
+	ar.String(material.specular_highlight_texname);
+	ar.String(material.bump_texname);
+	ar.String(material.displacement_texname);
+	ar.String(material.alpha_texname);
+	ar.String(material.reflection_texname);
+
+	SerializeTextureOption(ar, material.ambient_texopt);
+	SerializeTextureOption(ar, material.diffuse_texopt);
+	SerializeTextureOption(ar, material.specular_texopt);
+	SerializeTextureOption(ar, material.specular_highlight_texopt);
+	SerializeTextureOption(ar, material.bump_texopt);
+	SerializeTextureOption(ar, material.displacement_texopt);
+	SerializeTextureOption(ar, material.alpha_texopt);
+	SerializeTextureOption(ar, material.reflection_texopt);
+
+	ar.Value(material.roughness);
+	ar.Value(material.metallic);
+	ar.Value(material.sheen);
+	ar.Value(material.clearcoat_thickness);
+	ar.Value(material.clearcoat_roughness);
+	ar.Value(material.anisotropy);
+	ar.Value(material.anisotropy_rotation);
+
+	ar.String(material.roughness_texname);
+	ar.String(material.metallic_texname);
+	ar.String(material.sheen_texname);
+	ar.String(material.emissive_texname);
+	ar.String(material.normal_texname);
+
+	SerializeTextureOption(ar, material.roughness_texopt);
+	SerializeTextureOption(ar, material.metallic_texopt);
+	SerializeTextureOption(ar, material.sheen_texopt);
+	SerializeTextureOption(ar, material.emissive_texopt);
+	SerializeTextureOption(ar, material.normal_texopt);
+
+	ar.StringMap(material.unknown_parameter);
+}
+
+template <typename Archive, typename Tag>
+static void SerializeTag(Archive& ar, Tag& tag)
+{
+	ar.String(tag.name);
+	ar.Array(tag.intValues);
+	ar.Array(tag.floatValues);
+	SerializeEach(ar, tag.stringValues, [&](auto& str) { ar.String(str); });
+}
+
+template <typename Archive, typename Shape>
+static void SerializeShape(Archive& ar, Shape& shape)
+{
+	ar.String(shape.name);
+	ar.Array(shape.mesh.indices);
+	ar.Array(shape.mesh.num_face_vertices);
+	ar.Array(shape.mesh.material_ids);
+	ar.Array(shape.mesh.smoothing_group_ids);
+	SerializeEach(ar, shape.mesh.tags, [&](auto& tag) { SerializeTag(ar, tag); });
+}
+
+template <typename Archive, typename Attrib, typename Shapes, typename Materials>
+static void SerializeModel(Archive& ar, Attrib& attrib, Shapes& shapes, Materials& materials)
+{
+	ar.Array(attrib.vertices);
+	ar.Array(attrib.normals);
+	ar.Array(attrib.texcoords);
+	ar.Array(attrib.colors);
+	SerializeEach(ar, shapes, [&](auto& shape) { SerializeShape(ar, shape); });
+	SerializeEach(ar, materials, [&](auto& material) { SerializeMaterial(ar, material); });
+}
+
+static void WriteKey(CacheWriter& ar, const ObjCacheKey& key)
+{
+	ar.Bytes(s_magic, 8);
+	ar.Value(s_version);
+	ar.Value((uint32_t)sizeof(real_t));
+	ar.Value(key.size);
+	ar.Value(key.mtime);
+	ar.Value(key.hash);
+	ar.Bool(key.triangulate);
+}
+
+static bool ReadKey(CacheReader& ar, const ObjCacheKey& key)
+{
+	char magic[8];
+	uint32_t version, real_size;
+	ObjCacheKey stored;
+	ar.Bytes(magic, 8);
+	ar.Value(version);
+	ar.Value(real_size);
+	ar.Value(stored.size);
+	ar.Value(stored.mtime);
+	ar.Value(stored.hash);
+	ar.Bool(stored.triangulate);
+	return ar.ok() && memcmp(magic, s_magic, 8) == 0 && version == s_version && real_size == sizeof(real_t) &&
+		stored.size == key.size && stored.mtime == key.mtime && stored.hash == key.hash &&
+		stored.triangulate == key.triangulate;
+}
+
+bool SaveObjCache(const char* cache_filename, const ObjCacheKey& key, const tinyobj::attrib_t& attrib,
+	const std::vector<tinyobj::shape_t>& shapes, const std::vector<tinyobj::material_t>& materials)
+{
+	// Written to a temporary file and renamed, so that an interrupted write never leaves a cache
+	// that looks valid.
+	std::string tmp_filename = std::string(cache_filename) + ".tmp";
+	FILE* file = fopen(tmp_filename.c_str(), "wb");
+	if (file == nullptr) return false;
+
+	CacheWriter ar(file);
+	WriteKey(ar, key);
+	SerializeModel(ar, attrib, shapes, materials);
+	ar.Bytes(s_end_magic, 8);
+
+	bool ok = ar.ok();
+	if (fclose(file) != 0) ok = false;
+
+	std::error_code ec;
+	if (ok)
+	{
+		std::filesystem::rename(tmp_filename, cache_filename, ec);
+		ok = !ec;
+	}
+	if (!ok)
+	{
+		std::filesystem::remove(tmp_filename, ec);
+	}
+	return ok;
+}
+
+bool LoadObjCache(const char* cache_filename, const ObjCacheKey& key, tinyobj::attrib_t* attrib,
+	std::vector<tinyobj::shape_t>* shapes, std::vector<tinyobj::material_t>* materials)
+{
+	*attrib = tinyobj::attrib_t();
+	shapes->clear();
+	materials->clear();
+
+	MappedFile file;
+	if (!file.Open(cache_filename)) return false;
+
+	CacheReader ar(file.data(), file.size());
+	if (!ReadKey(ar, key)) return false;
+	SerializeModel(ar, *attrib, *shapes, *materials);
+
+	char end_magic[8];
+	ar.Bytes(end_magic, 8);
+	if (!ar.ok() || memcmp(end_magic, s_end_magic, 8) != 0)
+	{
+		*attrib = tinyobj::attrib_t();
+		shapes->clear();
+		materials->clear();
+		return false;
+	}
+	return true;
+}
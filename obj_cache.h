@@ -0,0 +1,30 @@
+#ifndef _obj_cache_h
+#define _obj_cache_h
+
+#include <cstdint>
+#include "obj_loader.h"
+
+// Identifies the parse of one .obj file. A cache is only used when all fields match.
+struct ObjCacheKey
+{
+	uint64_t size = 0;
+	int64_t mtime = 0;
+	uint64_t hash = 0; // crc64 of the file contents
+	bool triangulate = true;
+};
+
+bool ComputeObjCacheKey(const char* filename, const ObjLoadOptions& options, ObjCacheKey* key);
+
+// Binary cache of the result of LoadObjMapped(), written next to the .obj so that later
+// conversions of the same file can skip parsing. The arrays are stored 8-byte aligned in the
+// layout they have in memory, and loading maps the file and copies them out.
+// The key only covers the .obj: edits to the .mtl files it references are not detected.
+bool SaveObjCache(const char* cache_filename, const ObjCacheKey& key, const tinyobj::attrib_t& attrib,
+	const std::vector<tinyobj::shape_t>& shapes, const std::vector<tinyobj::material_t>& materials);
+
+// Returns false, leaving the outputs empty, if the cache is missing, damaged or was written for a
+// different key.
+bool LoadObjCache(const char* cache_filename, const ObjCacheKey& key, tinyobj::attrib_t* attrib,
+	std::vector<tinyobj::shape_t>* shapes, std::vector<tinyobj::material_t>* materials);
+
+#endif
@@ -0,0 +1,1544 @@
+#include <algorithm>
+#include <condition_variable>
+#include <cstring>
+#include <deque>
+#include <future>
+#include <mutex>
+#include <sstream>
+#include <streambuf>
+#include <thread>
+
+#include "obj_loader.h"
+#include "mapped_file.h"
+#include "block_reader.h"
+#include "parse_number.h"
+#include "task_queue.h"
+
+#define TINYOBJLOADER_IMPLEMENTATION
+#include "tiny_obj_loader.h"
+
+#if defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+#include <emmintrin.h>
+#define OBJ_LOADER_SSE2
+#endif
+
+#ifdef _MSC_VER
+#include <intrin.h>
+#endif
+
+using tinyobj::real_t;
+using tinyobj::vertex_index_t;
+
+static inline int CountTrailingZeros(unsigned int x)
+{
+#ifdef _MSC_VER
+	unsigned long idx;
+	_BitScanForward(&idx, x);
+	return (int)idx;
+#else
+	return __builtin_ctz(x);
+#endif
+}
+
+static inline int PopCount(unsigned int x)
+{
+#ifdef _MSC_VER
+	return (int)__popcnt(x);
+#else
+	return __builtin_popcount(x);
+#endif
+}
+
+// Returns the first '\n' or '\r' in [p, end), or end if there is none.
+static inline const char* FindLineEnd(const char* p, const char* end)
+{
+#ifdef OBJ_LOADER_SSE2
+	const __m128i nl = _mm_set1_epi8('\n');
+	const __m128i cr = _mm_set1_epi8('\r');
+	while (end - p >= 16)
+	{
+		__m128i chunk = _mm_loadu_si128((const __m128i*)p);
+		__m128i hit = _mm_or_si128(_mm_cmpeq_epi8(chunk, nl), _mm_cmpeq_epi8(chunk, cr));
+		int mask = _mm_movemask_epi8(hit);
+		if (mask != 0) return p + CountTrailingZeros((unsigned int)mask);
+		p += 16;
+	}
+#endif
+	while (p < end && *p != '\n' && *p != '\r') p++;
+	return p;
+}
+
+// Number of space separated tokens in [p, e).
+static inline size_t CountTokens(const char* p, const char* e)
+{
+	size_t count = 0;
+	unsigned int prev_in_token = 0;
+#ifdef OBJ_LOADER_SSE2
+	const __m128i space = _mm_set1_epi8(' ');
+	const __m128i tab = _mm_set1_epi8('\t');
+	while (e - p >= 16)
+	{
+		__m128i chunk = _mm_loadu_si128((const __m128i*)p);
+		__m128i blank = _mm_or_si128(_mm_cmpeq_epi8(chunk, space), _mm_cmpeq_epi8(chunk, tab));
+		unsigned int in_token = ~(unsigned int)_mm_movemask_epi8(blank) & 0xFFFF;
+		unsigned int starts = in_token & ~((in_token << 1) | prev_in_token);
+		count += PopCount(starts);
+		prev_in_token = in_token >> 15;
+		p += 16;
+	}
+#endif
+	for (; p < e; p++)
+	{
+		unsigned int in_token = IS_SPACE(*p) ? 0 : 1;
+		if (in_token && !prev_in_token) count++;
+		prev_in_token = in_token;
+	}
+	return count;
+}
+
+// The helpers below work on one line [p, e) of the mapped file. A line never contains '\r' or
+// '\n', and everything up to 'limit' (> e) is readable, so numbers can be read 8 bytes at a time.
+
+static inline const char* SkipSpace(const char* p, const char* e)
+{
+	while (p < e && IS_SPACE(*p)) p++;
+	return p;
+}
+
+static inline const char* SkipToken(const char* p, const char* e)
+{
+	while (p < e && !IS_SPACE(*p)) p++;
+	return p;
+}
+
+// Same as tinyobj::parseReal(), but correctly rounded.
+static inline real_t ParseReal(const char** token, const char* e, const char* limit, double default_value = 0.0)
+{
+	const char* p = SkipSpace(*token, e);
+	const char* end = SkipToken(p, e);
+	real_t val;
+	if (!ParseDecimal(p, end, limit, &val))
+	{
+		val = static_cast<real_t>(default_value);
+	}
+	*token = end;
+	return val;
+}
+
+// Same as atoi(), but stops at e. *token is moved past the digits, unless atoi() would have
+// skipped leading white space.
+static inline int ParseInt(const char** token, const char* e, const char* limit)
+{
+	const char* p = *token;
+	if (p < e && (IS_SPACE(*p) || *p == '\v' || *p == '\f'))
+	{
+		while (p < e && (IS_SPACE(*p) || *p == '\v' || *p == '\f')) p++;
+		return ParseInt(&p, e, limit);
+	}
+
+	bool negative = false;
+	if (p < e && (*p == '+' || *p == '-'))
+	{
+		negative = *p == '-';
+		p++;
+	}
+	uint64_t value = 0;
+	int num_digits = 0;
+	*token = AccumulateDigits(p, e, limit, &value, &num_digits);
+	return negative ? -(int)value : (int)value;
+}
+
+static inline const char* SkipIndex(const char* p, const char* e)
+{
+	while (p < e && *p != '/' && !IS_SPACE(*p)) p++;
+	return p;
+}
+
+enum
+{
+	RELATIVE_V = 1,
+	RELATIVE_VT = 2,
+	RELATIVE_VN = 4
+};
+
+static inline bool FixIndex(int idx, int n, int* ret, int* relative, int flag)
+{
+	if (idx < 0) *relative |= flag;
+	return tinyobj::fixIndex(idx, n, ret);
+}
+
+// Same as tinyobj::parseTriple(): i, i/j/k, i//k, i/j
+// 'relative' receives which of the indices were negative.
+static bool ParseTriple(const char** token, const char* e, const char* limit, int vsize, int vnsize, int vtsize, vertex_index_t* ret, int* relative)
+{
+	vertex_index_t vi(-1);
+	const char* p = *token;
+	*relative = 0;
+
+	if (!FixIndex(ParseInt(&p, e, limit), vsize, &vi.v_idx, relative, RELATIVE_V)) return false;
+	p = SkipIndex(p, e);
+	if (p >= e || *p != '/')
+	{
+		*token = p;
+		*ret = vi;
+		return true;
+	}
+	p++;
+
+	// i//k
+	if (p < e && *p == '/')
+	{
+		p++;
+		if (!FixIndex(ParseInt(&p, e, limit), vnsize, &vi.vn_idx, relative, RELATIVE_VN)) return false;
+		*token = SkipIndex(p, e);
+		*ret = vi;
+		return true;
+	}
+
+	// i/j/k or i/j
+	if (!FixIndex(ParseInt(&p, e, limit), vtsize, &vi.vt_idx, relative, RELATIVE_VT)) return false;
+	p = SkipIndex(p, e);
+	if (p >= e || *p != '/')
+	{
+		*token = p;
+		*ret = vi;
+		return true;
+	}
+
+	// i/j/k
+	p++;
+	if (!FixIndex(ParseInt(&p, e, limit), vnsize, &vi.vn_idx, relative, RELATIVE_VN)) return false;
+	*token = SkipIndex(p, e);
+	*ret = vi;
+	return true;
+}
+
+// Read-only std::streambuf over a memory range.
+class MemoryStreamBuf : public std::streambuf
+{
+public:
+	MemoryStreamBuf(const char* data, size_t size)
+	{
+		char* p = const_cast<char*>(data);
+		setg(p, p, p + size);
+	}
+};
+
+// tinyobj::MaterialFileReader, but the .mtl file is mapped instead of read through an ifstream.
+// Compressed .mtl files are decoded as they are parsed. A missing "name.mtl" is also looked for as
+// "name.mtl.gz" and "name.mtl.zst".
+class ObjMaterialReader : public tinyobj::MaterialReader
+{
+public:
+	explicit ObjMaterialReader(const std::string& mtl_basedir)
+		: m_mtlBaseDir(mtl_basedir) {}
+
+	virtual bool operator()(const std::string& matId, std::vector<tinyobj::material_t>* materials,
+		std::map<std::string, int>* matMap, std::string* err)
+	{
+		std::string filepath = m_mtlBaseDir + matId;
+
+		static const char* const suffixes[] = { "", ".gz", ".zst" };
+		Compression compression = Compression::None;
+		bool found = false;
+		for (const char* suffix : suffixes)
+		{
+			if (DetectCompression((filepath + suffix).c_str(), &compression))
+			{
+				filepath += suffix;
+				found = true;
+				break;
+			}
+		}
+
+		std::string warning;
+		if (found && compression == Compression::None)
+		{
+			MappedFile file;
+			found = file.Open(filepath.c_str());
+			if (found)
+			{
+				MemoryStreamBuf buf(file.data(), file.size());
+				std::istream stream(&buf);
+				tinyobj::LoadMtl(matMap, materials, &stream, &warning);
+			}
+		}
+		else if (found)
+		{
+			std::string open_err;
+			std::unique_ptr<BlockReader> reader = OpenBlockReader(filepath.c_str(), &open_err);
+			found = reader != nullptr;
+			if (found)
+			{
+				BlockStreamBuf buf(reader.get());
+				std::istream stream(&buf);
+				tinyobj::LoadMtl(matMap, materials, &stream, &warning);
+				if (reader->failed())
+				{
+					warning += "WARN: Failed to read material file [ " + filepath + " ]: " + reader->error() + "\n";
+				}
+			}
+			else if (err)
+			{
+				(*err) += open_err;
+			}
+		}
+
+		if (!found)
+		{
+			if (err)
+			{
+				(*err) += "WARN: Material file [ " + m_mtlBaseDir + matId + " ] not found.\n";
+			}
+			return false;
+		}
+
+		if (!warning.empty() && err)
+		{
+			(*err) += warning;
+		}
+		return true;
+	}
+
+private:
+	std::string m_mtlBaseDir;
+};
+
+// Runs func(0) .. func(n - 1), func(0) on the calling thread and the others on threads of their
+// own, or as tasks of 'queue' when there is one. Calls done(i) on the calling thread for every i
+// in order, as soon as func(0) .. func(i) have returned, while the later ones may still be
+// running. Stops calling done() once it returns false, and returns when all have run.
+template <typename Func, typename Done>
+static void ParallelForInOrder(TaskQueue* queue, int n, Func func, Done done)
+{
+	std::mutex mutex;
+	std::condition_variable finished;
+	std::vector<char> is_finished(std::max(n, 0), 0);
+	auto run = [&](int i)
+	{
+		func(i);
+		std::lock_guard<std::mutex> lock(mutex);
+		is_finished[i] = 1;
+		finished.notify_all();
+	};
+
+	std::vector<std::thread> threads;
+	for (int i = 1; i < n; i++)
+	{
+		if (queue != nullptr)
+		{
+			queue->Push([&run, i]() { run(i); });
+		}
+		else
+		{
+			threads.emplace_back(run, i);
+		}
+	}
+
+	bool more = true;
+	for (int i = 0; i < n; i++)
+	{
+		if (i == 0)
+		{
+			func(0);
+		}
+		else
+		{
+			std::unique_lock<std::mutex> lock(mutex);
+			finished.wait(lock, [&]() { return is_finished[i] != 0; });
+		}
+		if (more) more = done(i);
+	}
+	for (size_t i = 0; i < threads.size(); i++)
+	{
+		threads[i].join();
+	}
+}
+
+template <typename Func>
+static void ParallelFor(TaskQueue* queue, int n, Func func)
+{
+	ParallelForInOrder(queue, n, func, [](int) { return true; });
+}
+
+// A statement other than v/vn/vt/f, with the number of faces and vertex components parsed
+// before it in the same chunk.
+struct ObjStatement
+{
+	size_t face;
+	size_t vertex;
+	std::string line;
+};
+
+// A face corner with relative (negative) indices. Those are resolved against the counts of
+// the chunk while parsing, and shifted by the offsets of the chunk when merging.
+struct RelativeCorner
+{
+	size_t corner;
+	int mask;
+};
+
+// Records in one range of lines, counted by CountChunk() before parsing, so that the vertex
+// arrays can be allocated at their final size and every chunk told where its records go.
+struct ObjCounts
+{
+	size_t v = 0;
+	size_t vn = 0;
+	size_t vt = 0;
+	size_t faces = 0;
+	size_t corners = 0;
+	size_t polygons = 0; // faces that are not triangles
+};
+
+// Everything parsed from one range of lines of the file.
+struct ObjChunk
+{
+	std::vector<real_t> v;
+	std::vector<real_t> vn;
+	std::vector<real_t> vt;
+	std::vector<real_t> vc;
+	std::vector<ObjStatement> statements;
+	std::vector<RelativeCorner> relative;
+	bool failed = false;
+
+	// Number of v/vn/vt records parsed.
+	size_t num_v = 0;
+	size_t num_vn = 0;
+	size_t num_vt = 0;
+
+	// Faces are stored flat, face i being corners[face_offsets[i]] .. corners[face_offsets[i + 1] - 1].
+	// face_offsets stays empty as long as every face is a triangle, face i then starting at i * 3.
+	std::vector<vertex_index_t> corners;
+	std::vector<size_t> face_offsets;
+	size_t num_faces = 0;
+
+	// Number of v/vn/vt records in the chunks before this one.
+	size_t num_v_before = 0;
+	size_t num_vn_before = 0;
+	size_t num_vt_before = 0;
+
+	// When the file was counted first, v/vn/vt/vc above stay empty and the records go straight
+	// to the final arrays, starting at these pointers. Negative indices are then resolved
+	// while parsing.
+	bool presized = false;
+	ObjCounts counts;
+	real_t* v_out = nullptr;
+	real_t* vn_out = nullptr;
+	real_t* vt_out = nullptr;
+	real_t* vc_out = nullptr;
+};
+
+// Counts the v/vn/vt/f records in the lines in [begin, end), classifying lines the same way as
+// ParseChunk(), so that the vertex counts are exact. Face corners are counted as tokens, which
+// is exact for well-formed faces and only used for reserving memory.
+static void CountChunk(const char* begin, const char* end, ObjCounts* counts)
+{
+	const char* cur = begin;
+	while (cur < end)
+	{
+		const char* line_end = FindLineEnd(cur, end);
+		const char* token = SkipSpace(cur, line_end);
+		size_t len = (size_t)(line_end - token);
+		cur = line_end + 1;
+
+		if (len < 2) continue;
+		if (token[0] == 'v')
+		{
+			if (IS_SPACE(token[1]))
+			{
+				counts->v++;
+			}
+			else if (len >= 3 && IS_SPACE(token[2]))
+			{
+				if (token[1] == 'n') counts->vn++;
+				else if (token[1] == 't') counts->vt++;
+			}
+		}
+		else if (token[0] == 'f' && IS_SPACE(token[1]))
+		{
+			size_t num_corners = CountTokens(token + 2, line_end);
+			counts->faces++;
+			counts->corners += num_corners;
+			if (num_corners != 3) counts->polygons++;
+		}
+	}
+}
+
+// Parses the lines in [begin, end). 'begin' must be at the start of a line, and memory is
+// readable up to 'data_end' (>= end).
+// v/vn/vt/f lines are parsed in place; the other statements are recorded so that they can be
+// replayed in file order by ObjMerger.
+static void ParseChunk(const char* begin, const char* end, const char* data_end, ObjChunk* chunk)
+{
+	std::string tail;
+	const char* limit = data_end;
+
+	if (chunk->presized)
+	{
+		chunk->corners.reserve(chunk->counts.corners);
+	}
+
+	const char* cur = begin;
+	while (cur < end)
+	{
+		const char* line = cur;
+		const char* line_end = FindLineEnd(cur, end);
+		if (line_end < end)
+		{
+			cur = line_end + 1;
+			if (*line_end == '\r' && cur < end && *cur == '\n') cur++;
+		}
+		else
+		{
+			// The last line has no terminator. Copy it with some padding, so that the
+			// characters after the line are still readable.
+			tail.assign(line, line_end);
+			tail.append(8, '\0');
+			line = tail.c_str();
+			line_end = line + (tail.size() - 8);
+			limit = line + tail.size();
+			cur = end;
+		}
+
+		const char* token = SkipSpace(line, line_end);
+		if (token == line_end) continue;
+		if (token[0] == '#') continue;
+
+		// vertex
+		if (token[0] == 'v' && IS_SPACE(token[1]))
+		{
+			token += 2;
+			real_t x = ParseReal(&token, line_end, limit);
+			real_t y = ParseReal(&token, line_end, limit);
+			real_t z = ParseReal(&token, line_end, limit);
+			real_t r = ParseReal(&token, line_end, limit, 1.0);
+			real_t g = ParseReal(&token, line_end, limit, 1.0);
+			real_t b = ParseReal(&token, line_end, limit, 1.0);
+			if (chunk->presized)
+			{
+				real_t* pos = chunk->v_out + chunk->num_v * 3;
+				real_t* color = chunk->vc_out + chunk->num_v * 3;
+				pos[0] = x;
+				pos[1] = y;
+				pos[2] = z;
+				color[0] = r;
+				color[1] = g;
+				color[2] = b;
+			}
+			else
+			{
+				chunk->v.push_back(x);
+				chunk->v.push_back(y);
+				chunk->v.push_back(z);
+				chunk->vc.push_back(r);
+				chunk->vc.push_back(g);
+				chunk->vc.push_back(b);
+			}
+			chunk->num_v++;
+			continue;
+		}
+
+		// normal
+		if (token[0] == 'v' && token[1] == 'n' && IS_SPACE(token[2]))
+		{
+			token += 3;
+			real_t x = ParseReal(&token, line_end, limit);
+			real_t y = ParseReal(&token, line_end, limit);
+			real_t z = ParseReal(&token, line_end, limit);
+			if (chunk->presized)
+			{
+				real_t* normal = chunk->vn_out + chunk->num_vn * 3;
+				normal[0] = x;
+				normal[1] = y;
+				normal[2] = z;
+			}
+			else
+			{
+				chunk->vn.push_back(x);
+				chunk->vn.push_back(y);
+				chunk->vn.push_back(z);
+			}
+			chunk->num_vn++;
+			continue;
+		}
+
+		// texcoord
+		if (token[0] == 'v' && token[1] == 't' && IS_SPACE(token[2]))
+		{
+			token += 3;
+			real_t x = ParseReal(&token, line_end, limit);
+			real_t y = ParseReal(&token, line_end, limit);
+			if (chunk->presized)
+			{
+				real_t* texcoord = chunk->vt_out + chunk->num_vt * 2;
+				texcoord[0] = x;
+				texcoord[1] = y;
+			}
+			else
+			{
+				chunk->vt.push_back(x);
+				chunk->vt.push_back(y);
+			}
+			chunk->num_vt++;
+			continue;
+		}
+
+		// face
+		if (token[0] == 'f' && IS_SPACE(token[1]))
+		{
+			token = SkipSpace(token + 2, line_end);
+
+			int vsize = (int)chunk->num_v;
+			int vnsize = (int)chunk->num_vn;
+			int vtsize = (int)chunk->num_vt;
+			if (chunk->presized)
+			{
+				vsize += (int)chunk->num_v_before;
+				vnsize += (int)chunk->num_vn_before;
+				vtsize += (int)chunk->num_vt_before;
+			}
+
+			size_t first = chunk->corners.size();
+			while (token < line_end)
+			{
+				vertex_index_t vi;
+				int relative;
+				if (!ParseTriple(&token, line_end, limit, vsize, vnsize, vtsize, &vi, &relative))
+				{
+					chunk->failed = true;
+					return;
+				}
+				if (relative != 0 && !chunk->presized)
+				{
+					chunk->relative.push_back({ chunk->corners.size(), relative });
+				}
+				chunk->corners.push_back(vi);
+				token = SkipSpace(token, line_end);
+			}
+
+			if (chunk->face_offsets.empty() && chunk->corners.size() - first != 3)
+			{
+				// First face that is not a triangle: switch to explicit offsets.
+				if (chunk->presized) chunk->face_offsets.reserve(chunk->counts.faces + 1);
+				chunk->face_offsets.resize(chunk->num_faces + 1);
+				for (size_t i = 0; i <= chunk->num_faces; i++)
+				{
+					chunk->face_offsets[i] = i * 3;
+				}
+			}
+			chunk->num_faces++;
+			if (!chunk->face_offsets.empty())
+			{
+				chunk->face_offsets.push_back(chunk->corners.size());
+			}
+			continue;
+		}
+
+		switch (token[0])
+		{
+		case 'u': case 'm': case 'g': case 'o': case 't': case 's':
+			chunk->statements.push_back({ chunk->num_faces, chunk->num_v * 3, std::string(token, line_end) });
+			break;
+		}
+	}
+}
+
+// Consecutive faces of a chunk added to the face group, all with the same smoothing group.
+struct FaceRange
+{
+	const ObjChunk* chunk;
+	size_t begin;
+	size_t end;
+	unsigned int smoothing_id;
+};
+
+// Makes room for 'extra' more elements: exactly the first time, and with at least 50% growth
+// after that, so that a mesh exported in many parts is still copied a bounded number of times.
+template <typename T>
+static void ReserveMore(std::vector<T>* vec, size_t extra)
+{
+	size_t needed = vec->size() + extra;
+	if (needed <= vec->capacity()) return;
+	vec->reserve(std::max(needed, vec->size() + vec->size() / 2));
+}
+
+// Appends 'count' triangles, stored as 3 * count corners.
+static void AppendTriangles(tinyobj::mesh_t* mesh, const vertex_index_t* corners, size_t count,
+	int material_id, unsigned int smoothing_id)
+{
+	size_t first = mesh->indices.size();
+	mesh->indices.resize(first + count * 3);
+	tinyobj::index_t* out = &mesh->indices[first];
+	for (size_t i = 0; i < count * 3; i++)
+	{
+		out[i].vertex_index = corners[i].v_idx;
+		out[i].normal_index = corners[i].vn_idx;
+		out[i].texcoord_index = corners[i].vt_idx;
+	}
+	mesh->num_face_vertices.resize(mesh->num_face_vertices.size() + count, 3);
+	mesh->material_ids.resize(mesh->material_ids.size() + count, material_id);
+	mesh->smoothing_group_ids.resize(mesh->smoothing_group_ids.size() + count, smoothing_id);
+}
+
+// Port of the polygon case of tinyobj's exportFaceGroupToShape(), that only looks at the first
+// 'v_size' vertex components: the ones tinyobj would have parsed when the group is exported.
+// 'remaining' is scratch space for the ear clipping.
+static void ExportPolygon(tinyobj::mesh_t* mesh, const vertex_index_t* face, size_t npolys,
+	int material_id, unsigned int smoothing_id, bool triangulate, const real_t* v, size_t v_size,
+	std::vector<vertex_index_t>* remaining)
+{
+	if (npolys < 3) return;
+
+	if (triangulate)
+	{
+		vertex_index_t i0 = face[0];
+		vertex_index_t i1(-1);
+		vertex_index_t i2 = face[1];
+
+		// find the two axes to work in
+		size_t axes[2] = { 1, 2 };
+		for (size_t k = 0; k < npolys; ++k)
+		{
+			i0 = face[(k + 0) % npolys];
+			i1 = face[(k + 1) % npolys];
+			i2 = face[(k + 2) % npolys];
+			size_t vi0 = size_t(i0.v_idx);
+			size_t vi1 = size_t(i1.v_idx);
+			size_t vi2 = size_t(i2.v_idx);
+
+			if (((3 * vi0 + 2) >= v_size) || ((3 * vi1 + 2) >= v_size) || ((3 * vi2 + 2) >= v_size))
+			{
+				continue;
+			}
+			real_t v0x = v[vi0 * 3 + 0];
+			real_t v0y = v[vi0 * 3 + 1];
+			real_t v0z = v[vi0 * 3 + 2];
+			real_t v1x = v[vi1 * 3 + 0];
+			real_t v1y = v[vi1 * 3 + 1];
+			real_t v1z = v[vi1 * 3 + 2];
+			real_t v2x = v[vi2 * 3 + 0];
+			real_t v2y = v[vi2 * 3 + 1];
+			real_t v2z = v[vi2 * 3 + 2];
+			real_t e0x = v1x - v0x;
+			real_t e0y = v1y - v0y;
+			real_t e0z = v1z - v0z;
+			real_t e1x = v2x - v1x;
+			real_t e1y = v2y - v1y;
+			real_t e1z = v2z - v1z;
+			real_t cx = std::fabs(e0y * e1z - e0z * e1y);
+			real_t cy = std::fabs(e0z * e1x - e0x * e1z);
+			real_t cz = std::fabs(e0x * e1y - e0y * e1x);
+			const real_t epsilon = std::numeric_limits<real_t>::epsilon();
+			if (cx > epsilon || cy > epsilon || cz > epsilon)
+			{
+				// found a corner
+				if (cx > cy && cx > cz)
+				{
+				}
+				else
+				{
+					axes[0] = 0;
+					if (cz > cx && cz > cy) axes[1] = 1;
+				}
+				break;
+			}
+		}
+
+		real_t area = 0;
+		for (size_t k = 0; k < npolys; ++k)
+		{
+			i0 = face[(k + 0) % npolys];
+			i1 = face[(k + 1) % npolys];
+			size_t vi0 = size_t(i0.v_idx);
+			size_t vi1 = size_t(i1.v_idx);
+			if (((vi0 * 3 + axes[0]) >= v_size) || ((vi0 * 3 + axes[1]) >= v_size) ||
+				((vi1 * 3 + axes[0]) >= v_size) || ((vi1 * 3 + axes[1]) >= v_size))
+			{
+				continue;
+			}
+			real_t v0x = v[vi0 * 3 + axes[0]];
+			real_t v0y = v[vi0 * 3 + axes[1]];
+			real_t v1x = v[vi1 * 3 + axes[0]];
+			real_t v1y = v[vi1 * 3 + axes[1]];
+			area += (v0x * v1y - v0y * v1x) * static_cast<real_t>(0.5);
+		}
+
+		int maxRounds = 10;
+
+		remaining->assign(face, face + npolys);
+		size_t guess_vert = 0;
+		vertex_index_t ind[3];
+		real_t vx[3];
+		real_t vy[3];
+		while (remaining->size() > 3 && maxRounds > 0)
+		{
+			npolys = remaining->size();
+			if (guess_vert >= npolys)
+			{
+				maxRounds -= 1;
+				guess_vert -= npolys;
+			}
+			for (size_t k = 0; k < 3; k++)
+			{
+				ind[k] = (*remaining)[(guess_vert + k) % npolys];
+				size_t vi = size_t(ind[k].v_idx);
+				if (((vi * 3 + axes[0]) >= v_size) || ((vi * 3 + axes[1]) >= v_size))
+				{
+					vx[k] = static_cast<real_t>(0.0);
+					vy[k] = static_cast<real_t>(0.0);
+				}
+				else
+				{
+					vx[k] = v[vi * 3 + axes[0]];
+					vy[k] = v[vi * 3 + axes[1]];
+				}
+			}
+			real_t e0x = vx[1] - vx[0];
+			real_t e0y = vy[1] - vy[0];
+			real_t e1x = vx[2] - vx[1];
+			real_t e1y = vy[2] - vy[1];
+			real_t cross = e0x * e1y - e0y * e1x;
+			// if an internal angle
+			if (cross * area < static_cast<real_t>(0.0))
+			{
+				guess_vert += 1;
+				continue;
+			}
+
+			// check all other verts in case they are inside this triangle
+			bool overlap = false;
+			for (size_t otherVert = 3; otherVert < npolys; ++otherVert)
+			{
+				size_t idx = (guess_vert + otherVert) % npolys;
+				if (idx >= remaining->size()) continue;
+
+				size_t ovi = size_t((*remaining)[idx].v_idx);
+				if (((ovi * 3 + axes[0]) >= v_size) || ((ovi * 3 + axes[1]) >= v_size)) continue;
+
+				real_t tx = v[ovi * 3 + axes[0]];
+				real_t ty = v[ovi * 3 + axes[1]];
+				if (tinyobj::pnpoly(3, vx, vy, tx, ty))
+				{
+					overlap = true;
+					break;
+				}
+			}
+
+			if (overlap)
+			{
+				guess_vert += 1;
+				continue;
+			}
+
+			// this triangle is an ear
+			for (size_t k = 0; k < 3; k++)
+			{
+				tinyobj::index_t idx;
+				idx.vertex_index = ind[k].v_idx;
+				idx.normal_index = ind[k].vn_idx;
+				idx.texcoord_index = ind[k].vt_idx;
+				mesh->indices.push_back(idx);
+			}
+			mesh->num_face_vertices.push_back(3);
+			mesh->material_ids.push_back(material_id);
+			mesh->smoothing_group_ids.push_back(smoothing_id);
+
+			// remove v1 from the list
+			size_t removed_vert_index = (guess_vert + 1) % npolys;
+			while (removed_vert_index + 1 < npolys)
+			{
+				(*remaining)[removed_vert_index] = (*remaining)[removed_vert_index + 1];
+				removed_vert_index += 1;
+			}
+			remaining->pop_back();
+		}
+
+		if (remaining->size() == 3)
+		{
+			for (size_t k = 0; k < 3; k++)
+			{
+				const vertex_index_t& vi = (*remaining)[k];
+				tinyobj::index_t idx;
+				idx.vertex_index = vi.v_idx;
+				idx.normal_index = vi.vn_idx;
+				idx.texcoord_index = vi.vt_idx;
+				mesh->indices.push_back(idx);
+			}
+			mesh->num_face_vertices.push_back(3);
+			mesh->material_ids.push_back(material_id);
+			mesh->smoothing_group_ids.push_back(smoothing_id);
+		}
+	}
+	else
+	{
+		for (size_t k = 0; k < npolys; k++)
+		{
+			tinyobj::index_t idx;
+			idx.vertex_index = face[k].v_idx;
+			idx.normal_index = face[k].vn_idx;
+			idx.texcoord_index = face[k].vt_idx;
+			mesh->indices.push_back(idx);
+		}
+		mesh->num_face_vertices.push_back(static_cast<unsigned char>(npolys));
+		mesh->material_ids.push_back(material_id);
+		mesh->smoothing_group_ids.push_back(smoothing_id);
+	}
+}
+
+// Port of tinyobj's exportFaceGroupToShape().
+// Triangles are copied as they are, in bulk for chunks that contain nothing else, as
+// triangulating them would not change them.
+static bool ExportFaceGroup(tinyobj::shape_t* shape, const std::vector<FaceRange>& faceGroup,
+	const std::vector<tinyobj::tag_t>& tags, int material_id, const std::string& name, bool triangulate,
+	const real_t* v, size_t v_size, std::vector<vertex_index_t>* remaining)
+{
+	if (faceGroup.empty()) return false;
+
+	// Number of faces and indices the group turns into. Exact unless ear clipping gives up on a
+	// polygon.
+	size_t num_faces = 0;
+	size_t num_indices = 0;
+	for (size_t i = 0; i < faceGroup.size(); i++)
+	{
+		const FaceRange& range = faceGroup[i];
+		size_t faces = range.end - range.begin;
+		size_t corners = faces * 3;
+		if (!range.chunk->face_offsets.empty())
+		{
+			corners = range.chunk->face_offsets[range.end] - range.chunk->face_offsets[range.begin];
+		}
+		if (triangulate && corners != faces * 3)
+		{
+			faces = corners > faces * 2 ? corners - faces * 2 : 0;
+			corners = faces * 3;
+		}
+		num_faces += faces;
+		num_indices += corners;
+	}
+	ReserveMore(&shape->mesh.indices, num_indices);
+	ReserveMore(&shape->mesh.num_face_vertices, num_faces);
+	ReserveMore(&shape->mesh.material_ids, num_faces);
+	ReserveMore(&shape->mesh.smoothing_group_ids, num_faces);
+
+	for (size_t i = 0; i < faceGroup.size(); i++)
+	{
+		const FaceRange& range = faceGroup[i];
+		const ObjChunk& chunk = *range.chunk;
+
+		if (chunk.face_offsets.empty())
+		{
+			AppendTriangles(&shape->mesh, &chunk.corners[range.begin * 3], range.end - range.begin,
+				material_id, range.smoothing_id);
+			continue;
+		}
+
+		for (size_t j = range.begin; j < range.end; j++)
+		{
+			const vertex_index_t* face = chunk.corners.data() + chunk.face_offsets[j];
+			size_t npolys = chunk.face_offsets[j + 1] - chunk.face_offsets[j];
+			if (npolys == 3)
+			{
+				AppendTriangles(&shape->mesh, face, 1, material_id, range.smoothing_id);
+			}
+			else
+			{
+				ExportPolygon(&shape->mesh, face, npolys, material_id, range.smoothing_id, triangulate,
+					v, v_size, remaining);
+			}
+		}
+	}
+
+	shape->name = name;
+	shape->mesh.tags = tags;
+
+	return true;
+}
+
+// Replays the parsed chunks in file order, carrying the usemtl/mtllib/g/o/s/t state of
+// tinyobj::LoadObj() across chunk boundaries.
+class ObjMerger
+{
+public:
+	ObjMerger(tinyobj::attrib_t* attrib, std::vector<tinyobj::shape_t>* shapes, std::vector<tinyobj::material_t>* materials,
+		std::string* err, tinyobj::MaterialReader* readMatFn, bool triangulate, const ObjShapeCallback* on_shape)
+		: m_attrib(attrib), m_shapes(shapes), m_materials(materials), m_err(err), m_readMatFn(readMatFn), m_triangulate(triangulate),
+		m_on_shape(on_shape), m_v(attrib->vertices) {}
+
+	// Merges chunks[i], the chunks before it having been merged already. Its vertex data is
+	// appended to 'attrib' first, unless it was parsed in place. Returns false if the chunk
+	// failed to parse, as tinyobj stops at the failed line.
+	// The chunks must not move until the load is done, hence the deque.
+	bool AddChunk(std::deque<ObjChunk>& chunks, size_t i);
+
+	void Finish()
+	{
+		bool ret = Export(m_v.size());
+		if (ret || m_shape.mesh.indices.size())
+		{
+			PushShape();
+		}
+		m_faceGroup.clear();
+	}
+
+private:
+	void AddFaces(const ObjChunk& chunk, size_t begin, size_t end)
+	{
+		if (begin < end)
+		{
+			m_faceGroup.push_back({ &chunk, begin, end, m_smoothing_id });
+		}
+	}
+
+	// 'v_size' is the number of vertex components parsed before the statement.
+	void Apply(const std::string& line, size_t v_size);
+
+	void PushShape()
+	{
+		if (m_on_shape != nullptr)
+		{
+			(*m_on_shape)(std::move(m_shape));
+		}
+		else
+		{
+			m_shapes->push_back(std::move(m_shape));
+		}
+	}
+
+	bool Export(size_t v_size)
+	{
+		return ExportFaceGroup(&m_shape, m_faceGroup, m_tags, m_material, m_name, m_triangulate, m_v.data(), v_size, &m_remaining);
+	}
+
+	tinyobj::attrib_t* m_attrib;
+	std::vector<tinyobj::shape_t>* m_shapes;
+	std::vector<tinyobj::material_t>* m_materials;
+	std::string* m_err;
+	tinyobj::MaterialReader* m_readMatFn;
+	bool m_triangulate;
+	const ObjShapeCallback* m_on_shape;
+	const std::vector<real_t>& m_v;
+
+	std::vector<tinyobj::tag_t> m_tags;
+	std::vector<FaceRange> m_faceGroup;
+	std::vector<vertex_index_t> m_remaining;
+	std::string m_name;
+	std::map<std::string, int> m_material_map;
+	int m_material = -1;
+	unsigned int m_smoothing_id = 0;
+	tinyobj::shape_t m_shape;
+	size_t m_num_released = 0; // chunks whose faces have been freed
+};
+
+// Appends 'src' to 'dst', growing it like ReserveMore().
+static void AppendMore(std::vector<real_t>* dst, std::vector<real_t>& src)
+{
+	ReserveMore(dst, src.size());
+	dst->insert(dst->end(), src.begin(), src.end());
+	std::vector<real_t>().swap(src);
+}
+
+bool ObjMerger::AddChunk(std::deque<ObjChunk>& chunks, size_t i)
+{
+	ObjChunk& chunk = chunks[i];
+	if (!chunk.presized)
+	{
+		chunk.num_v_before = m_attrib->vertices.size() / 3;
+		chunk.num_vn_before = m_attrib->normals.size() / 3;
+		chunk.num_vt_before = m_attrib->texcoords.size() / 2;
+		AppendMore(&m_attrib->vertices, chunk.v);
+		AppendMore(&m_attrib->normals, chunk.vn);
+		AppendMore(&m_attrib->texcoords, chunk.vt);
+		AppendMore(&m_attrib->colors, chunk.vc);
+
+		for (size_t j = 0; j < chunk.relative.size(); j++)
+		{
+			const RelativeCorner& corner = chunk.relative[j];
+			vertex_index_t& vi = chunk.corners[corner.corner];
+			if (corner.mask & RELATIVE_V) vi.v_idx += (int)chunk.num_v_before;
+			if (corner.mask & RELATIVE_VT) vi.vt_idx += (int)chunk.num_vt_before;
+			if (corner.mask & RELATIVE_VN) vi.vn_idx += (int)chunk.num_vn_before;
+		}
+		std::vector<RelativeCorner>().swap(chunk.relative);
+	}
+
+	size_t face = 0;
+	for (size_t j = 0; j < chunk.statements.size(); j++)
+	{
+		const ObjStatement& statement = chunk.statements[j];
+		AddFaces(chunk, face, statement.face);
+		Apply(statement.line, chunk.num_v_before * 3 + statement.vertex);
+		face = statement.face;
+	}
+	AddFaces(chunk, face, chunk.num_faces);
+	std::vector<ObjStatement>().swap(chunk.statements);
+
+	// What the chunk holds ends at the failed line.
+	if (chunk.failed)
+	{
+		if (m_err)
+		{
+			(*m_err) = "Failed parse `f' line(e.g. zero value for face index).\n";
+		}
+		return false;
+	}
+
+	// Free the faces of the chunks that have been exported, up to the oldest one still pending.
+	const ObjChunk* in_use = m_faceGroup.empty() ? nullptr : m_faceGroup[0].chunk;
+	for (; m_num_released <= i && &chunks[m_num_released] != in_use; m_num_released++)
+	{
+		std::vector<vertex_index_t>().swap(chunks[m_num_released].corners);
+		std::vector<size_t>().swap(chunks[m_num_released].face_offsets);
+	}
+	return true;
+}
+
+void ObjMerger::Apply(const std::string& line, size_t v_size)
+{
+	const char* token = line.c_str();
+
+	// use mtl
+	if ((0 == strncmp(token, "usemtl", 6)) && IS_SPACE(token[6]))
+	{
+		std::string namebuf = token + 7;
+
+		int newMaterialId = -1;
+		auto iter = m_material_map.find(namebuf);
+		if (iter != m_material_map.end())
+		{
+			newMaterialId = iter->second;
+		}
+
+		if (newMaterialId != m_material)
+		{
+			Export(v_size);
+			m_faceGroup.clear();
+			m_material = newMaterialId;
+		}
+		return;
+	}
+
+	// load mtl
+	if ((0 == strncmp(token, "mtllib", 6)) && IS_SPACE(token[6]))
+	{
+		if (m_readMatFn)
+		{
+			std::vector<std::string> filenames;
+			tinyobj::SplitString(std::string(token + 7), ' ', filenames);
+
+			if (filenames.empty())
+			{
+				if (m_err)
+				{
+					(*m_err) += "WARN: Looks like empty filename for mtllib. Use default material. \n";
+				}
+			}
+			else
+			{
+				bool found = false;
+				for (size_t s = 0; s < filenames.size(); s++)
+				{
+					std::string err_mtl;
+					bool ok = (*m_readMatFn)(filenames[s].c_str(), m_materials, &m_material_map, &err_mtl);
+					if (m_err && !err_mtl.empty())
+					{
+						(*m_err) += err_mtl;
+					}
+					if (ok)
+					{
+						found = true;
+						break;
+					}
+				}
+
+				if (!found && m_err)
+				{
+					(*m_err) += "WARN: Failed to load material file(s). Use default material.\n";
+				}
+			}
+		}
+		return;
+	}
+
+	// group name
+	if (token[0] == 'g' && IS_SPACE(token[1]))
+	{
+		Export(v_size);
+		if (m_shape.mesh.indices.size() > 0)
+		{
+			PushShape();
+		}
+		m_shape = tinyobj::shape_t();
+		m_faceGroup.clear();
+
+		std::vector<std::string> names;
+		while (!IS_NEW_LINE(token[0]))
+		{
+			names.push_back(tinyobj::parseString(&token));
+			token += strspn(token, " \t\r");
+		}
+
+		// names[0] must be 'g', so skip the 0th element.
+		if (names.size() > 1)
+		{
+			m_name = names[1];
+		}
+		else
+		{
+			m_name = "";
+		}
+		return;
+	}
+
+	// object name
+	if (token[0] == 'o' && IS_SPACE(token[1]))
+	{
+		// Like tinyobj, the pending shape is only kept when faces were added after the
+		// last `usemtl`.
+		if (Export(v_size))
+		{
+			PushShape();
+		}
+		m_faceGroup.clear();
+		m_shape = tinyobj::shape_t();
+
+		m_name = token + 2;
+		return;
+	}
+
+	// tag
+	if (token[0] == 't' && IS_SPACE(token[1]))
+	{
+		const int max_tag_nums = 8192;
+		tinyobj::tag_t tag;
+
+		token += 2;
+		tag.name = tinyobj::parseString(&token);
+
+		tinyobj::tag_sizes ts = tinyobj::parseTagTriple(&token);
+		if (ts.num_ints < 0) ts.num_ints = 0;
+		if (ts.num_ints > max_tag_nums) ts.num_ints = max_tag_nums;
+		if (ts.num_reals < 0) ts.num_reals = 0;
+		if (ts.num_reals > max_tag_nums) ts.num_reals = max_tag_nums;
+		if (ts.num_strings < 0) ts.num_strings = 0;
+		if (ts.num_strings > max_tag_nums) ts.num_strings = max_tag_nums;
+
+		tag.intValues.resize((size_t)ts.num_ints);
+		for (size_t i = 0; i < (size_t)ts.num_ints; i++)
+		{
+			tag.intValues[i] = tinyobj::parseInt(&token);
+		}
+
+		tag.floatValues.resize((size_t)ts.num_reals);
+		for (size_t i = 0; i < (size_t)ts.num_reals; i++)
+		{
+			tag.floatValues[i] = tinyobj::parseReal(&token);
+		}
+
+		tag.stringValues.resize((size_t)ts.num_strings);
+		for (size_t i = 0; i < (size_t)ts.num_strings; i++)
+		{
+			tag.stringValues[i] = tinyobj::parseString(&token);
+		}
+
+		m_tags.push_back(tag);
+		return;
+	}
+
+	// smoothing group id
+	if (token[0] == 's' && IS_SPACE(token[1]))
+	{
+		token += 2;
+		token += strspn(token, " \t");
+
+		if (token[0] == '\0') return;
+		if (token[0] == '\r' || token[1] == '\n') return;
+
+		if (strlen(token) >= 3)
+		{
+			if (token[0] == 'o' && token[1] == 'f' && token[2] == 'f')
+			{
+				m_smoothing_id = 0;
+			}
+		}
+		else
+		{
+			int smGroupId = tinyobj::parseInt(&token);
+			m_smoothing_id = smGroupId < 0 ? 0 : (unsigned int)smGroupId;
+		}
+		return;
+	}
+
+	// Ignore unknown command.
+}
+
+static int NumThreads(const ObjLoadOptions& options)
+{
+	int num_threads = options.num_threads;
+	if (num_threads <= 0 && options.queue != nullptr) num_threads = options.queue->NumThreads();
+	if (num_threads <= 0) num_threads = (int)std::thread::hardware_concurrency();
+	if (num_threads <= 0) num_threads = 1;
+	return num_threads;
+}
+
+// Splits [data, data_end) at line boundaries into at most 'num_threads' ranges of at least about
+// a megabyte. Returns the range bounds.
+static std::vector<const char*> SplitLines(const char* data, const char* data_end, int num_threads)
+{
+	const size_t min_chunk_size = 1 << 20;
+
+	size_t size = (size_t)(data_end - data);
+	int num_chunks = (int)std::min((size_t)num_threads, size / min_chunk_size + 1);
+
+	std::vector<const char*> bounds(num_chunks + 1);
+	bounds[0] = data;
+	bounds[num_chunks] = data_end;
+	for (int i = 1; i < num_chunks; i++)
+	{
+		const char* p = std::max(data + size / num_chunks * i, bounds[i - 1]);
+		p = FindLineEnd(p, data_end);
+		if (p < data_end) p++;
+		bounds[i] = p;
+	}
+	return bounds;
+}
+
+static void ClearOutputs(tinyobj::attrib_t* attrib, std::vector<tinyobj::shape_t>* shapes)
+{
+	attrib->vertices.clear();
+	attrib->normals.clear();
+	attrib->texcoords.clear();
+	attrib->colors.clear();
+	if (shapes) shapes->clear();
+}
+
+static bool LoadObjFromMemory(tinyobj::attrib_t* attrib, std::vector<tinyobj::shape_t>* shapes,
+	std::vector<tinyobj::material_t>* materials, std::string* err,
+	const char* data, size_t size, tinyobj::MaterialReader* readMatFn, const ObjLoadOptions& options)
+{
+	int num_threads = NumThreads(options);
+	const char* data_end = data + size;
+	std::vector<const char*> bounds = SplitLines(data, data_end, num_threads);
+	int num_chunks = (int)bounds.size() - 1;
+
+	std::deque<ObjChunk> chunks(num_chunks);
+	if (options.presize)
+	{
+		ParallelFor(options.queue, num_chunks, [&](int i)
+		{
+			CountChunk(bounds[i], bounds[i + 1], &chunks[i].counts);
+		});
+
+		size_t num_v = 0, num_vn = 0, num_vt = 0;
+		for (int i = 0; i < num_chunks; i++)
+		{
+			ObjChunk& chunk = chunks[i];
+			chunk.num_v_before = num_v;
+			chunk.num_vn_before = num_vn;
+			chunk.num_vt_before = num_vt;
+			num_v += chunk.counts.v;
+			num_vn += chunk.counts.vn;
+			num_vt += chunk.counts.vt;
+		}
+
+		// 'attrib' has its final size from here on, so the chunks parse into it and the ones
+		// parsed first can be merged while the others are still being written.
+		attrib->vertices.resize(num_v * 3);
+		attrib->normals.resize(num_vn * 3);
+		attrib->texcoords.resize(num_vt * 2);
+		attrib->colors.resize(num_v * 3);
+
+		for (int i = 0; i < num_chunks; i++)
+		{
+			ObjChunk& chunk = chunks[i];
+			chunk.presized = true;
+			chunk.v_out = attrib->vertices.data() + chunk.num_v_before * 3;
+			chunk.vn_out = attrib->normals.data() + chunk.num_vn_before * 3;
+			chunk.vt_out = attrib->texcoords.data() + chunk.num_vt_before * 2;
+			chunk.vc_out = attrib->colors.data() + chunk.num_v_before * 3;
+		}
+	}
+
+	// Every chunk is merged as soon as it and the ones before it are parsed.
+	ObjMerger merger(attrib, shapes, materials, err, readMatFn, options.triangulate, options.on_shape ? &options.on_shape : nullptr);
+	bool merged = true;
+	ParallelForInOrder(options.queue, num_chunks, [&](int i)
+	{
+		ParseChunk(bounds[i], bounds[i + 1], data_end, &chunks[i]);
+	}, [&](int i)
+	{
+		merged = merger.AddChunk(chunks, i);
+		return merged;
+	});
+	if (!merged)
+	{
+		ClearOutputs(attrib, shapes);
+		return false;
+	}
+	merger.Finish();
+	return true;
+}
+
+// Parses blocks of the decoded file while the next block is being read and decoded. The text
+// only ever exists one block at a time (two counting the one being read); like the presize=false
+// path, every block is parsed into chunks of its own, which are appended to 'attrib' and merged
+// as soon as they are parsed.
+static bool LoadObjFromBlocks(tinyobj::attrib_t* attrib, std::vector<tinyobj::shape_t>* shapes,
+	std::vector<tinyobj::material_t>* materials, std::string* err,
+	BlockReader* reader, tinyobj::MaterialReader* readMatFn, const ObjLoadOptions& options)
+{
+	// The parser reads up to 16 bytes past the last digits of a line.
+	const size_t padding = 64;
+
+	int num_threads = NumThreads(options);
+	size_t block_size = std::max(options.block_size, (size_t)1 << 16);
+	std::vector<char> buffers[2];
+	buffers[0].resize(block_size + padding);
+	buffers[1].resize(block_size + padding);
+
+	std::deque<ObjChunk> chunks;
+	ObjMerger merger(attrib, shapes, materials, err, readMatFn, options.triangulate, options.on_shape ? &options.on_shape : nullptr);
+	int cur = 0;
+	size_t carry = 0; // incomplete last line of the previous block, at the start of the buffer
+	size_t count = reader->Read(buffers[cur].data(), block_size);
+	bool failed = false;
+
+	while (true)
+	{
+		std::vector<char>& buffer = buffers[cur];
+		size_t size = carry + count;
+		bool last = count < buffer.size() - padding - carry;
+
+		// Parse up to the end of the last complete line and keep the rest for the next block.
+		const char* data = buffer.data();
+		const char* data_end = data + size;
+		const char* parse_end = data_end;
+		if (!last)
+		{
+			while (parse_end > data && parse_end[-1] != '\n' && parse_end[-1] != '\r') parse_end--;
+			if (parse_end == data)
+			{
+				// No line ends within the buffer: make it larger.
+				buffer.resize(buffer.size() * 2);
+				carry = size;
+				count = reader->Read(buffer.data() + carry, buffer.size() - padding - carry);
+				continue;
+			}
+		}
+		memset(buffer.data() + size, 0, padding);
+
+		// Move the incomplete line to the other buffer and start reading after it.
+		std::vector<char>& next = buffers[1 - cur];
+		size_t next_carry = (size_t)(data_end - parse_end);
+		std::future<size_t> next_count;
+		if (!last)
+		{
+			if (next.size() < next_carry + block_size + padding) next.resize(next_carry + block_size + padding);
+			memcpy(next.data(), parse_end, next_carry);
+			next_count = std::async(std::launch::async, [reader, &next, next_carry, padding]()
+			{
+				return reader->Read(next.data() + next_carry, next.size() - padding - next_carry);
+			});
+		}
+
+		std::vector<const char*> bounds = SplitLines(data, parse_end, num_threads);
+		int num_chunks = (int)bounds.size() - 1;
+		size_t first = chunks.size();
+		chunks.resize(first + num_chunks);
+		ParallelForInOrder(options.queue, num_chunks, [&](int i)
+		{
+			ParseChunk(bounds[i], bounds[i + 1], data_end + padding, &chunks[first + i]);
+		}, [&](int i)
+		{
+			failed = !merger.AddChunk(chunks, first + i);
+			return !failed;
+		});
+
+		if (last) break;
+		count = next_count.get();
+		carry = next_carry;
+		cur = 1 - cur;
+
+		// tinyobj stops at a failed face line, so the rest of the file is not needed.
+		if (failed) break;
+	}
+
+	if (reader->failed())
+	{
+		if (err)
+		{
+			(*err) = "Failed to read the .obj data: " + reader->error() + "\n";
+		}
+		failed = true;
+	}
+	if (failed)
+	{
+		ClearOutputs(attrib, shapes);
+		return false;
+	}
+	merger.Finish();
+	return true;
+}
+
+static std::string MaterialBaseDir(const char* mtl_basedir)
+{
+	std::string baseDir;
+	if (mtl_basedir)
+	{
+		baseDir = mtl_basedir;
+#ifndef _WIN32
+		const char dirsep = '/';
+#else
+		const char dirsep = '\\';
+#endif
+		if (baseDir.empty() || baseDir[baseDir.length() - 1] != dirsep)
+			baseDir += dirsep;
+	}
+	return baseDir;
+}
+
+
+bool LoadObjMapped(tinyobj::attrib_t* attrib, std::vector<tinyobj::shape_t>* shapes,
+	std::vector<tinyobj::material_t>* materials, std::string* err,
+	const char* filename, const char* mtl_basedir, const ObjLoadOptions& options)
+{
+	ClearOutputs(attrib, shapes);
+
+	MappedFile file;
+	if (!file.Open(filename))
+	{
+		if (err)
+		{
+			(*err) = std::string("Cannot open file [") + filename + "]\n";
+		}
+		return false;
+	}
+
+	ObjMaterialReader matReader(MaterialBaseDir(mtl_basedir));
+	return LoadObjFromMemory(attrib, shapes, materials, err, file.data(), file.size(), &matReader, options);
+}
+
+bool LoadObjStream(tinyobj::attrib_t* attrib, std::vector<tinyobj::shape_t>* shapes,
+	std::vector<tinyobj::material_t>* materials, std::string* err,
+	BlockReader* reader, const char* mtl_basedir, const ObjLoadOptions& options)
+{
+	ClearOutputs(attrib, shapes);
+
+	ObjMaterialReader matReader(MaterialBaseDir(mtl_basedir));
+	return LoadObjFromBlocks(attrib, shapes, materials, err, reader, &matReader, options);
+}
+
+bool LoadObjFile(tinyobj::attrib_t* attrib, std::vector<tinyobj::shape_t>* shapes,
+	std::vector<tinyobj::material_t>* materials, std::string* err,
+	const char* filename, const char* mtl_basedir, const ObjLoadOptions& options)
+{
+	Compression compression;
+	if (DetectCompression(filename, &compression) && compression == Compression::None)
+	{
+		return LoadObjMapped(attrib, shapes, materials, err, filename, mtl_basedir, options);
+	}
+
+	ClearOutputs(attrib, shapes);
+	std::unique_ptr<BlockReader> reader = OpenBlockReader(filename, err);
+	if (!reader) return false;
+	return LoadObjStream(attrib, shapes, materials, err, reader.get(), mtl_basedir, options);
+}
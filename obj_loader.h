@@ -0,0 +1,65 @@
+#ifndef _obj_loader_h
+#define _obj_loader_h
+
+#include <functional>
+#include "tiny_obj_loader.h"
+
+class BlockReader;
+class TaskQueue;
+
+// Takes each shape as soon as its faces are final, in file order, on the thread that called the
+// load function. Shapes are handed out while the rest of the file is still being parsed and
+// merged, so only the shape is complete: 'attrib' is not until the load returns. The shapes
+// taken are not added to 'shapes'. When the load fails part way, the shapes handed out before
+// the failure have been taken all the same.
+typedef std::function<void(tinyobj::shape_t&& shape)> ObjShapeCallback;
+
+struct ObjLoadOptions
+{
+	bool triangulate = true;
+
+	// Threads parsing the file in parallel. 0 means one per hardware thread, or one per worker
+	// of 'queue'.
+	int num_threads = 0;
+
+	// Parse on the workers of this pool instead of on threads of the loader's own, so that the
+	// parsing shares the CPU with the work that on_shape starts there. The load must not be
+	// started from one of its tasks.
+	TaskQueue* queue = nullptr;
+
+	// Count the records in a first pass over the file, so that the vertex arrays are allocated
+	// once at their final size and parsed into directly. Costs an extra scan of the file, saves
+	// growing and copying the arrays, which roughly halves peak memory.
+	bool presize = true;
+
+	// Compressed input is decoded and parsed in blocks of this many bytes, which bounds the
+	// memory used by the text.
+	size_t block_size = 16 << 20;
+
+	// Takes the shapes as they are merged instead of 'shapes'.
+	ObjShapeCallback on_shape;
+};
+
+// Drop-in replacement for tinyobj::LoadObj() reading from a file.
+// The .obj and .mtl files are memory mapped and tokenized in place, without copying lines out
+// of the mapping. The .obj is split at line boundaries into chunks that are parsed concurrently,
+// each merged in file order as soon as it and the chunks before it are parsed. Results are the same as tinyobj::LoadObj(), except that numbers are
+// correctly rounded where tinyobj's parser can be off by a few ulps.
+bool LoadObjMapped(tinyobj::attrib_t* attrib, std::vector<tinyobj::shape_t>* shapes,
+	std::vector<tinyobj::material_t>* materials, std::string* err,
+	const char* filename, const char* mtl_basedir = nullptr, const ObjLoadOptions& options = ObjLoadOptions());
+
+// Same as LoadObjMapped(), for data that has to be read front to back, like compressed files.
+// Blocks are parsed while the next one is decoded; the whole text is never held in memory.
+// Counting first (ObjLoadOptions::presize) is not possible here.
+bool LoadObjStream(tinyobj::attrib_t* attrib, std::vector<tinyobj::shape_t>* shapes,
+	std::vector<tinyobj::material_t>* materials, std::string* err,
+	BlockReader* reader, const char* mtl_basedir = nullptr, const ObjLoadOptions& options = ObjLoadOptions());
+
+// Maps plain .obj files, and streams gzip or zstd compressed ones (recognized by their contents,
+// not their name).
+bool LoadObjFile(tinyobj::attrib_t* attrib, std::vector<tinyobj::shape_t>* shapes,
+	std::vector<tinyobj::material_t>* materials, std::string* err,
+	const char* filename, const char* mtl_basedir = nullptr, const ObjLoadOptions& options = ObjLoadOptions());
+
+#endif
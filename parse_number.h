@@ -0,0 +1,273 @@
+#ifndef _parse_number_h
+#define _parse_number_h
+
+// Number parsing for OBJ tokens.
+// Digit runs are converted 8 characters at a time (SWAR). Decimal numbers are correctly rounded:
+// the common short mantissas are converted exactly with Clinger's fast path, everything else goes
+// through std::from_chars() (strtod() where that is unavailable).
+
+#include <cstdint>
+#include <cstring>
+#include <cstdlib>
+#include <cfloat>
+#include <cmath>
+#include <string>
+#include <charconv>
+
+#ifdef _MSC_VER
+#include <intrin.h>
+#endif
+
+#if defined(_WIN32) || (defined(__BYTE_ORDER__) && __BYTE_ORDER__ == __ORDER_LITTLE_ENDIAN__)
+#define PARSE_NUMBER_SWAR
+#endif
+
+inline int CountTrailingZeros64(uint64_t x)
+{
+#ifdef _MSC_VER
+	unsigned long idx;
+	_BitScanForward64(&idx, x);
+	return (int)idx;
+#else
+	return __builtin_ctzll(x);
+#endif
+}
+
+inline bool IsDecimalDigit(char c)
+{
+	return (unsigned char)(c - '0') < 10;
+}
+
+// Number of leading decimal digits in 8 characters loaded little-endian.
+inline int CountLeadingDigits8(uint64_t val)
+{
+	uint64_t high = (val & 0xF0F0F0F0F0F0F0F0ull) ^ 0x3030303030303030ull;
+	uint64_t low = ((val + 0x0606060606060606ull) & 0xF0F0F0F0F0F0F0F0ull) ^ 0x3030303030303030ull;
+	uint64_t non_digit = high | low;
+	if (non_digit == 0) return 8;
+	return CountTrailingZeros64(non_digit) >> 3;
+}
+
+// Value of the first 'count' (1..8) digits of 8 characters loaded little-endian.
+inline uint32_t DigitsValue8(uint64_t val, int count)
+{
+	if (count < 8)
+	{
+		// Move the digits to the end and pad the front with '0'.
+		val = (val << (8 * (8 - count))) | (0x3030303030303030ull >> (8 * count));
+	}
+	const uint64_t mask = 0x000000FF000000FFull;
+	const uint64_t mul1 = 100 + (1000000ull << 32);
+	const uint64_t mul2 = 1 + (10000ull << 32);
+	val -= 0x3030303030303030ull;
+	val = (val * 10) + (val >> 8);
+	val = (((val & mask) * mul1) + (((val >> 16) & mask) * mul2)) >> 32;
+	return (uint32_t)val;
+}
+
+// Appends the digits at p (stopping at 'end') to *value and counts them in *num_digits.
+// Characters up to 'limit' (>= end) may be read. *value wraps around past 19 digits.
+inline const char* AccumulateDigits(const char* p, const char* end, const char* limit, uint64_t* value, int* num_digits)
+{
+	static const uint64_t pow10[] = { 1, 10, 100, 1000, 10000, 100000, 1000000, 10000000, 100000000 };
+
+	uint64_t v = *value;
+#ifdef PARSE_NUMBER_SWAR
+	while (limit - p >= 8)
+	{
+		uint64_t bytes;
+		memcpy(&bytes, p, 8);
+		int count = CountLeadingDigits8(bytes);
+		if (count > end - p) count = (int)(end - p);
+		if (count > 0)
+		{
+			v = v * pow10[count] + DigitsValue8(bytes, count);
+			p += count;
+			*num_digits += count;
+		}
+		if (count < 8)
+		{
+			*value = v;
+			return p;
+		}
+	}
+#endif
+	while (p < end && IsDecimalDigit(*p))
+	{
+		v = v * 10 + (uint64_t)(*p - '0');
+		p++;
+		(*num_digits)++;
+	}
+	*value = v;
+	return p;
+}
+
+// Exact when m and 10^|e| are both exactly representable and only one rounding happens.
+inline bool DecimalToFloatFast(uint64_t m, int e, double* out)
+{
+	static const double pow10d[] = { 1e0, 1e1, 1e2, 1e3, 1e4, 1e5, 1e6, 1e7, 1e8, 1e9, 1e10, 1e11,
+		1e12, 1e13, 1e14, 1e15, 1e16, 1e17, 1e18, 1e19, 1e20, 1e21, 1e22 };
+
+	if (m <= (1ull << 53) && e >= -22 && e <= 22)
+	{
+		double d = (double)m;
+		*out = e < 0 ? d / pow10d[-e] : d * pow10d[e];
+		return true;
+	}
+	return false;
+}
+
+inline bool DecimalToFloatFast(uint64_t m, int e, float* out)
+{
+	static const double pow10d[] = { 1e-22, 1e-21, 1e-20, 1e-19, 1e-18, 1e-17, 1e-16, 1e-15, 1e-14,
+		1e-13, 1e-12, 1e-11, 1e-10, 1e-9, 1e-8, 1e-7, 1e-6, 1e-5, 1e-4, 1e-3, 1e-2, 1e-1,
+		1e0, 1e1, 1e2, 1e3, 1e4, 1e5, 1e6, 1e7, 1e8, 1e9, 1e10, 1e11,
+		1e12, 1e13, 1e14, 1e15, 1e16, 1e17, 1e18, 1e19, 1e20, 1e21, 1e22 };
+
+	if (m == 0)
+	{
+		*out = 0.0f;
+		return true;
+	}
+	if (m > (1ull << 53) || e < -22 || e > 22) return false;
+
+	// Multiplying by the rounded 10^e is within 2 ulps of the exact double, which has 29 bits
+	// more than a float. Rounding d to float is therefore correct unless it lies within a few
+	// ulps of a point halfway between two floats. This avoids a division.
+	double d = (double)m * pow10d[e + 22];
+	if (d < FLT_MIN || d > FLT_MAX) return false;
+	uint64_t bits;
+	memcpy(&bits, &d, 8);
+	if (((bits - 0x10000000ull + 4) & 0x1FFFFFFFull) <= 8) return false;
+	*out = (float)d;
+	return true;
+}
+
+// Correctly rounded conversion of an unsigned decimal number [s, end) matched by ParseDecimal().
+template <typename T>
+inline T DecimalToFloatSlow(const char* s, const char* end, bool overflow)
+{
+	T value = 0;
+#if defined(__cpp_lib_to_chars)
+	std::from_chars_result res = std::from_chars(s, end, value);
+	if (res.ec == std::errc::result_out_of_range)
+	{
+		value = overflow ? (T)HUGE_VAL : (T)0;
+	}
+#else
+	(void)overflow;
+	std::string str(s, end);
+	if (sizeof(T) == sizeof(float))
+	{
+		value = (T)strtof(str.c_str(), nullptr);
+	}
+	else
+	{
+		value = (T)strtod(str.c_str(), nullptr);
+	}
+#endif
+	return value;
+}
+
+// Parses a decimal number at the start of [s, end), accepting the same syntax as tinyobj's
+// tryParseDouble():
+//   [sign] digit {digit} ["." {digit}] [("e" | "E") [sign] digit {digit}]
+// and ignoring anything after it. Characters up to 'limit' (>= end) may be read.
+// Returns false, leaving *result untouched, if there is no number.
+template <typename T>
+inline bool ParseDecimal(const char* s, const char* end, const char* limit, T* result)
+{
+	const char* p = s;
+	if (p >= end) return false;
+
+	// Branch-free sign: '+' and '-' are equally likely in vertex data.
+	bool negative = *p == '-';
+	p += (negative || *p == '+') ? 1 : 0;
+	const char* number = p;
+
+#ifdef PARSE_NUMBER_SWAR
+	// Fast path for the usual "int.frac" token with no exponent and at most 7 digits on either
+	// side of the point.
+	if (limit - p >= 16)
+	{
+		static const uint64_t pow10[] = { 1, 10, 100, 1000, 10000, 100000, 1000000, 10000000 };
+
+		uint64_t int_bytes;
+		memcpy(&int_bytes, p, 8);
+		int int_count = CountLeadingDigits8(int_bytes);
+		if (int_count > 0 && int_count < 8 && int_count < end - p && p[int_count] == '.')
+		{
+			const char* fraction = p + int_count + 1;
+			uint64_t frac_bytes;
+			memcpy(&frac_bytes, fraction, 8);
+			int frac_count = CountLeadingDigits8(frac_bytes);
+			if (frac_count > end - fraction) frac_count = (int)(end - fraction);
+			const char* q = fraction + frac_count;
+			if (frac_count < 8 && (q == end || (*q != 'e' && *q != 'E')))
+			{
+				uint64_t mantissa = DigitsValue8(int_bytes, int_count);
+				if (frac_count > 0)
+				{
+					mantissa = mantissa * pow10[frac_count] + DigitsValue8(frac_bytes, frac_count);
+				}
+				T value;
+				if (DecimalToFloatFast(mantissa, -frac_count, &value))
+				{
+					*result = negative ? -value : value;
+					return true;
+				}
+			}
+		}
+	}
+#endif
+
+	uint64_t mantissa = 0;
+	int num_digits = 0;
+	int exponent = 0;
+
+	while (p < end && *p == '0') p++;
+	p = AccumulateDigits(p, end, limit, &mantissa, &num_digits);
+	if (p == number) return false;
+
+	if (p < end && *p == '.')
+	{
+		p++;
+		const char* fraction = p;
+		if (mantissa == 0)
+		{
+			while (p < end && *p == '0') p++;
+		}
+		p = AccumulateDigits(p, end, limit, &mantissa, &num_digits);
+		exponent -= (int)(p - fraction);
+	}
+
+	if (p < end && (*p == 'e' || *p == 'E'))
+	{
+		p++;
+		bool exp_negative = false;
+		if (p < end && (*p == '+' || *p == '-'))
+		{
+			exp_negative = *p == '-';
+			p++;
+		}
+		const char* exp_digits = p;
+		int exp_value = 0;
+		while (p < end && IsDecimalDigit(*p))
+		{
+			if (exp_value < 100000) exp_value = exp_value * 10 + (*p - '0');
+			p++;
+		}
+		if (p == exp_digits) return false;
+		exponent += exp_negative ? -exp_value : exp_value;
+	}
+
+	T value;
+	if (num_digits > 19 || !DecimalToFloatFast(mantissa, exponent, &value))
+	{
+		value = DecimalToFloatSlow<T>(number, p, exponent + num_digits > 0);
+	}
+	*result = negative ? -value : value;
+	return true;
+}
+
+#endif
@@ -0,0 +1,165 @@
+#include <cstdint>
+#include <cstring>
+#include <algorithm>
+
+#include "sort_weld.h"
+
+// Groups larger than this resolve their vn/vt by sorting instead of comparing with each distinct one.
+static const size_t s_max_scan_group = 16;
+
+static int BitWidth(uint32_t x)
+{
+	int bits = 0;
+	for (; x != 0; x >>= 1) bits++;
+	return bits;
+}
+
+static inline bool SameTriple(const tinyobj::index_t& a, const tinyobj::index_t& b)
+{
+	return a.vertex_index == b.vertex_index && a.normal_index == b.normal_index && a.texcoord_index == b.texcoord_index;
+}
+
+void SortWeld(const tinyobj::index_t* indices, const int* faces, size_t num_faces,
+	std::vector<tinyobj::index_t>* vertices, int* corner_vertices)
+{
+	size_t num_corners = num_faces * 3;
+	vertices->clear();
+	if (num_corners == 0) return;
+
+	// Missing indices are -1, shifted to 0. Keys only get as wide as the largest indices need.
+	uint32_t max_v = 0, max_n = 0, max_t = 0;
+	for (size_t f = 0; f < num_faces; f++)
+	{
+		const tinyobj::index_t* corner = indices + (size_t)faces[f] * 3;
+		for (int k = 0; k < 3; k++)
+		{
+			max_v |= (uint32_t)(corner[k].vertex_index + 1);
+			max_n |= (uint32_t)(corner[k].normal_index + 1);
+			max_t |= (uint32_t)(corner[k].texcoord_index + 1);
+		}
+	}
+	int bits_v = BitWidth(max_v);
+	int bits_n = BitWidth(max_n);
+	int bits_t = BitWidth(max_t);
+	// The key is the whole triple when it fits in 32 bits, else the v index alone.
+	int bits = bits_v + bits_n + bits_t;
+	bool exact = bits <= 32;
+	if (!exact) bits = bits_v;
+	int num_bytes = (bits + 7) / 8;
+
+	// Items are the key in the upper half and the corner number in the lower half.
+	std::vector<uint64_t> items(num_corners);
+	size_t histograms[4][256];
+	memset(histograms, 0, sizeof(histograms));
+	for (size_t f = 0; f < num_faces; f++)
+	{
+		const tinyobj::index_t* corner = indices + (size_t)faces[f] * 3;
+		for (int k = 0; k < 3; k++)
+		{
+			uint32_t key = (uint32_t)(corner[k].vertex_index + 1);
+			if (exact)
+			{
+				if (bits_n > 0) key |= (uint32_t)(corner[k].normal_index + 1) << bits_v;
+				if (bits_t > 0) key |= (uint32_t)(corner[k].texcoord_index + 1) << (bits_v + bits_n);
+			}
+			for (int b = 0; b < num_bytes; b++)
+			{
+				histograms[b][(key >> (b * 8)) & 0xff]++;
+			}
+			items[f * 3 + k] = (uint64_t)key << 32 | (uint32_t)(f * 3 + k);
+		}
+	}
+
+	// LSD radix sort of the keys, one byte per pass. Each pass is stable, so the corners of
+	// equal keys stay in order.
+	std::vector<uint64_t> sorted(num_corners);
+	for (int b = 0; b < num_bytes; b++)
+	{
+		int shift = 32 + b * 8;
+		size_t* histogram = histograms[b];
+		if (histogram[(items[0] >> shift) & 0xff] == num_corners) continue; // all the same
+		size_t offset = 0;
+		for (int d = 0; d < 256; d++)
+		{
+			size_t count = histogram[d];
+			histogram[d] = offset;
+			offset += count;
+		}
+		for (size_t i = 0; i < num_corners; i++)
+		{
+			uint64_t item = items[i];
+			sorted[histogram[(item >> shift) & 0xff]++] = item;
+		}
+		items.swap(sorted);
+	}
+	std::vector<uint64_t>().swap(sorted);
+
+	auto triple = [indices, faces](uint64_t item) -> const tinyobj::index_t&
+	{
+		uint32_t corner = (uint32_t)item;
+		return indices[(size_t)faces[corner / 3] * 3 + corner % 3];
+	};
+
+	// Numbers the distinct triples ("runs") in key order, writing the run of each corner.
+	int num_runs = 0;
+	for (size_t begin = 0; begin < num_corners;)
+	{
+		uint32_t key = (uint32_t)(items[begin] >> 32);
+		size_t end = begin + 1;
+		while (end < num_corners && (uint32_t)(items[end] >> 32) == key) end++;
+
+		if (exact || end - begin == 1)
+		{
+			for (size_t i = begin; i < end; i++)
+			{
+				corner_vertices[(uint32_t)items[i]] = num_runs;
+			}
+			num_runs++;
+		}
+		else if (end - begin <= s_max_scan_group)
+		{
+			// Corners sharing a v index: compare with the distinct triples found so far.
+			size_t distinct[s_max_scan_group];
+			int num_distinct = 0;
+			for (size_t i = begin; i < end; i++)
+			{
+				const tinyobj::index_t& index = triple(items[i]);
+				int d = 0;
+				while (d < num_distinct && !SameTriple(triple(items[distinct[d]]), index)) d++;
+				if (d == num_distinct) distinct[num_distinct++] = i;
+				corner_vertices[(uint32_t)items[i]] = num_runs + d;
+			}
+			num_runs += num_distinct;
+		}
+		else
+		{
+			std::stable_sort(items.begin() + begin, items.begin() + end, [&triple](uint64_t a, uint64_t b)
+			{
+				const tinyobj::index_t& index_a = triple(a);
+				const tinyobj::index_t& index_b = triple(b);
+				if (index_a.normal_index != index_b.normal_index) return index_a.normal_index < index_b.normal_index;
+				return index_a.texcoord_index < index_b.texcoord_index;
+			});
+			for (size_t i = begin; i < end; i++)
+			{
+				if (i == begin || !SameTriple(triple(items[i]), triple(items[i - 1]))) num_runs++;
+				corner_vertices[(uint32_t)items[i]] = num_runs - 1;
+			}
+		}
+		begin = end;
+	}
+
+	// Renumbers the runs in order of first use.
+	std::vector<int> run_vertices(num_runs, -1);
+	vertices->reserve(num_runs);
+	for (size_t c = 0; c < num_corners; c++)
+	{
+		int& vertex = run_vertices[corner_vertices[c]];
+		if (vertex < 0)
+		{
+			vertex = (int)vertices->size();
+			vertices->push_back(indices[(size_t)faces[c / 3] * 3 + c % 3]);
+		}
+		corner_vertices[c] = vertex;
+	}
+}
@@ -0,0 +1,19 @@
+#ifndef _sort_weld_h
+#define _sort_weld_h
+
+#include <vector>
+#include "tiny_obj_loader.h"
+
+// Welds the corners of triangles 'faces' of 'indices' (3 per face) that have the same
+// v/vn/vt index triple, without a hash table: each corner is packed into a 64-bit item with its
+// triple as the key, the items are radix sorted, and one sweep over them finds the distinct
+// triples. When the triple doesn't fit in 32 bits the key is just the v index, and the few
+// corners sharing a v are told apart by their vn/vt.
+// Same result as welding with a hash table: 'vertices' gets the distinct triples in order of
+// first use, 'corner_vertices' (3 per face) the number of the vertex of each corner.
+// Works in sequential passes, which beats random hash table probes once the table no longer
+// fits in cache and the faces are roughly in vertex order, as exported meshes are.
+void SortWeld(const tinyobj::index_t* indices, const int* faces, size_t num_faces,
+	std::vector<tinyobj::index_t>* vertices, int* corner_vertices);
+
+#endif
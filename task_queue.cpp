@@ -0,0 +1,116 @@
+#include "task_queue.h"
+
+// The queue and worker the current thread works for, if it is a worker thread.
+static thread_local const TaskQueue* t_queue = nullptr;
+static thread_local size_t t_worker = 0;
+
+TaskQueue::TaskQueue(int num_threads)
+	: m_num_queued(0), m_num_pending(0), m_next_worker(0)
+{
+	if (num_threads <= 0)
+	{
+		num_threads = (int)std::thread::hardware_concurrency();
+		if (num_threads <= 0) num_threads = 1;
+	}
+	for (int i = 0; i < num_threads; i++)
+	{
+		m_workers.emplace_back(new Worker);
+	}
+	for (int i = 0; i < num_threads; i++)
+	{
+		m_threads.emplace_back(&TaskQueue::Work, this, (size_t)i);
+	}
+}
+
+TaskQueue::~TaskQueue()
+{
+	Wait();
+	{
+		std::lock_guard<std::mutex> lock(m_mutex);
+		m_stop = true;
+	}
+	m_task_ready.notify_all();
+	for (std::thread& thread : m_threads)
+	{
+		thread.join();
+	}
+}
+
+void TaskQueue::Push(std::function<void()> task)
+{
+	size_t worker = t_queue == this ? t_worker : m_next_worker++ % m_workers.size();
+	m_num_pending++;
+	{
+		// Counted under the lock that Take() decrements under, so the count never drops below zero.
+		std::lock_guard<std::mutex> lock(m_workers[worker]->mutex);
+		m_workers[worker]->tasks.push_back(std::move(task));
+		m_num_queued++;
+	}
+
+	// Taking the lock orders this with a worker that is about to sleep, so the wake-up is not lost.
+	{
+		std::lock_guard<std::mutex> lock(m_mutex);
+	}
+	m_task_ready.notify_one();
+}
+
+void TaskQueue::Wait()
+{
+	std::unique_lock<std::mutex> lock(m_mutex);
+	m_all_done.wait(lock, [this]() { return m_num_pending == 0; });
+}
+
+bool TaskQueue::Take(size_t worker, std::function<void()>* task)
+{
+	{
+		Worker& own = *m_workers[worker];
+		std::lock_guard<std::mutex> lock(own.mutex);
+		if (!own.tasks.empty())
+		{
+			*task = std::move(own.tasks.back());
+			own.tasks.pop_back();
+			m_num_queued--;
+			return true;
+		}
+	}
+
+	for (size_t i = 1; i < m_workers.size(); i++)
+	{
+		Worker& victim = *m_workers[(worker + i) % m_workers.size()];
+		std::lock_guard<std::mutex> lock(victim.mutex);
+		if (!victim.tasks.empty())
+		{
+			*task = std::move(victim.tasks.front());
+			victim.tasks.pop_front();
+			m_num_queued--;
+			return true;
+		}
+	}
+	return false;
+}
+
+void TaskQueue::Work(size_t worker)
+{
+	t_queue = this;
+	t_worker = worker;
+
+	std::function<void()> task;
+	while (true)
+	{
+		if (Take(worker, &task))
+		{
+			task();
+			task = nullptr;
+			if (--m_num_pending == 0)
+			{
+				std::lock_guard<std::mutex> lock(m_mutex);
+				m_all_done.notify_all();
+			}
+			continue;
+		}
+
+		std::unique_lock<std::mutex> lock(m_mutex);
+		m_task_ready.wait(lock, [this]() { return m_stop || m_num_queued > 0; });
+		if (m_stop && m_num_queued == 0) return;
+	}
+}
@@ -0,0 +1,60 @@
+#ifndef _task_queue_h
+#define _task_queue_h
+
+#include <atomic>
+#include <condition_variable>
+#include <deque>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+// Work-stealing thread pool. Every worker has its own deque: tasks pushed by a task go to the
+// back of its worker's deque and are taken from there again (newest first, while their data is
+// still in cache), idle workers steal the oldest tasks from the front of the others' deques.
+// Tasks pushed from other threads are dealt out to the workers in turn.
+class TaskQueue
+{
+public:
+	// 0 threads means one per hardware thread.
+	explicit TaskQueue(int num_threads = 0);
+
+	// Finishes the pending tasks first.
+	~TaskQueue();
+
+	TaskQueue(const TaskQueue&) = delete;
+	TaskQueue& operator=(const TaskQueue&) = delete;
+
+	// Can be called from any thread, including from inside a task.
+	void Push(std::function<void()> task);
+
+	int NumThreads() const { return (int)m_threads.size(); }
+
+	// Blocks until all tasks pushed so far, and the tasks they push, have run.
+	// Must not be called from inside a task.
+	void Wait();
+
+private:
+	struct Worker
+	{
+		std::mutex mutex;
+		std::deque<std::function<void()>> tasks;
+	};
+
+	bool Take(size_t worker, std::function<void()>* task);
+	void Work(size_t worker);
+
+	std::vector<std::unique_ptr<Worker>> m_workers;
+	std::vector<std::thread> m_threads;
+	std::atomic<size_t> m_num_queued;
+	std::atomic<size_t> m_num_pending; // queued or running
+	std::atomic<size_t> m_next_worker;
+
+	std::mutex m_mutex;
+	std::condition_variable m_task_ready;
+	std::condition_variable m_all_done;
+	bool m_stop = false;
+};
+
+#endif
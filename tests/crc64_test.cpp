@@ -0,0 +1,83 @@
+#include <cstdio>
+#include <random>
+#include <vector>
+
+#include "crc64.h"
+
+typedef uint64_t (*Crc64Func)(uint64_t crc, const unsigned char* s, uint64_t l);
+
+struct Crc64Impl
+{
+	const char* name;
+	Crc64Func func;
+};
+
+// Checks every implementation against the bytewise one, on random buffers starting at every
+// alignment and of lengths around the block sizes of the faster ones.
+int main()
+{
+	std::vector<Crc64Impl> impls;
+	impls.push_back({ "slice8", crc64_slice8 });
+	impls.push_back({ "slice16", crc64_slice16 });
+	if (crc64_has_clmul())
+	{
+		impls.push_back({ "clmul", crc64_clmul });
+	}
+	else
+	{
+		printf("PCLMULQDQ not supported, skipping crc64_clmul\n");
+	}
+	impls.push_back({ "crc64", crc64 });
+
+	int num_failed = 0;
+	// The check value of crc-64-jones, see crc64.cpp.
+	const unsigned char check[] = "123456789";
+	std::vector<Crc64Impl> checked = impls;
+	checked.push_back({ "bytewise", crc64_bytewise });
+	for (const Crc64Impl& impl : checked)
+	{
+		uint64_t crc = impl.func(0, check, 9);
+		if (crc != UINT64_C(0xe9c6d914c4b8d9ca))
+		{
+			printf("%s: check value %016llx\n", impl.name, (unsigned long long)crc);
+			num_failed++;
+		}
+	}
+
+	std::mt19937_64 rng(1);
+	std::vector<unsigned char> buffer((1 << 16) + 64);
+	for (unsigned char& b : buffer) b = (unsigned char)rng();
+
+	const int num_cases = 20000;
+	for (int i = 0; i < num_cases; i++)
+	{
+		size_t offset = rng() % 64;
+		// Mostly short lengths, where the head and tail handling is, and some long ones.
+		size_t length = rng() % (i % 8 == 0 ? (1 << 16) : 512);
+		uint64_t init = i % 2 == 0 ? 0 : rng();
+
+		const unsigned char* s = buffer.data() + offset;
+		uint64_t expected = crc64_bytewise(init, s, length);
+		for (const Crc64Impl& impl : impls)
+		{
+			uint64_t crc = impl.func(init, s, length);
+			if (crc != expected)
+			{
+				if (num_failed < 20)
+				{
+					printf("%s: offset %d length %d init %016llx: %016llx, expected %016llx\n", impl.name,
+						(int)offset, (int)length, (unsigned long long)init, (unsigned long long)crc, (unsigned long long)expected);
+				}
+				num_failed++;
+			}
+		}
+	}
+
+	if (num_failed > 0)
+	{
+		printf("%d failed\n", num_failed);
+		return 1;
+	}
+	printf("all passed\n");
+	return 0;
+}
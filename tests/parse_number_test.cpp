@@ -0,0 +1,146 @@
+#include <cmath>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <random>
+#include <string>
+#include <vector>
+
+#include "parse_number.h"
+
+// Checks ParseDecimal() against strtof() and strtod(), which round correctly, on the token
+// shapes exporters write and on the cases that are easy to get wrong: values halfway between two
+// floats, mantissas too long for the fast paths, overflow, underflow and subnormals.
+
+static int s_num_failed = 0;
+
+template <typename T>
+static T Reference(const char* s);
+
+template <>
+float Reference<float>(const char* s)
+{
+	return strtof(s, nullptr);
+}
+
+template <>
+double Reference<double>(const char* s)
+{
+	return strtod(s, nullptr);
+}
+
+template <typename T>
+static void Check(const std::string& token)
+{
+	// Padded the way the loader pads its buffers, so the 8-byte reads stay inside.
+	std::string padded = token + std::string(16, '\0');
+	const char* s = padded.c_str();
+	T expected = Reference<T>(s);
+	T value = (T)-12345;
+	bool parsed = ParseDecimal(s, s + token.size(), s + padded.size(), &value);
+	if (!parsed || memcmp(&value, &expected, sizeof(T)) != 0)
+	{
+		if (s_num_failed < 20)
+		{
+			printf("%s \"%s\": %.17g, expected %.17g\n", sizeof(T) == sizeof(float) ? "float" : "double",
+				token.c_str(), (double)value, (double)expected);
+		}
+		s_num_failed++;
+	}
+}
+
+static void CheckBoth(const std::string& token)
+{
+	Check<float>(token);
+	Check<double>(token);
+}
+
+// The digits of the exact value of a double, which needs up to 767 significant digits.
+static std::string ExactDigits(double d)
+{
+	char buffer[1100];
+	snprintf(buffer, sizeof(buffer), "%.1074e", d);
+	return buffer;
+}
+
+int main()
+{
+	static const char* const tokens[] = {
+		"0", "-0", "+0", "0.0", "000000000000000000000000001", "1", "-1", "+1.5", "1.", "12345678",
+		"0.000001", "-0.5", "3.14159265358979323846264338327950288", "1e10", "1E-10", "-2.5e+3",
+		"123456789012345678901234567890", "0.0000000000000000000000000000001234567",
+		"1.00000005960464477539062500", // halfway between 1 and the next float: ties to even
+		"1.00000017881393432617187500", // halfway between the next two: ties up to even
+		"1.000000059604644775390625001", // just above halfway
+		"1.000000059604644775390624999", // just below halfway
+		"9007199254740993", // halfway between two doubles
+		"9007199254740993.0000000000000000001",
+		"3.4028234663852886e38", // FLT_MAX
+		"3.4028235677973366e38", // halfway between FLT_MAX and the next power of two: overflows
+		"3.4028235677973365e38", // just below that: FLT_MAX
+		"1e39", "-1e39", "1e308", "1.7976931348623157e308", "1e309", "-1e309", "1e99999",
+		"1.17549435e-38", // FLT_MIN
+		"1e-40", "1.4e-45", "7e-46", "1e-46", // float subnormals and underflow
+		"2.2250738585072014e-308", "4.9406564584124654e-324", "2.4703282292062328e-324", "1e-400",
+		"0.1", "0.2", "0.3", "7.038531e-26", "8.589973e9",
+	};
+	for (const char* token : tokens) CheckBoth(token);
+
+	// Every float halfway point between the neighbors of some values, written out exactly, then
+	// nudged by one in the last of many digits.
+	std::mt19937_64 rng(1);
+	for (int i = 0; i < 2000; i++)
+	{
+		uint32_t bits = (uint32_t)rng() & 0x7f7fffff;
+		float f;
+		memcpy(&f, &bits, 4);
+		double halfway = ((double)f + (double)nextafterf(f, INFINITY)) / 2;
+		std::string exact = ExactDigits(halfway);
+		CheckBoth(exact);
+		size_t e = exact.find('e');
+		std::string mantissa = exact.substr(0, e);
+		std::string exponent = exact.substr(e);
+		mantissa = mantissa.substr(0, mantissa.find_last_not_of('0') + 1);
+		CheckBoth(mantissa + "1" + exponent);
+		// One below, from the last nonzero digit.
+		std::string below = mantissa;
+		size_t last = below.find_last_not_of("0.");
+		if (last != std::string::npos && below[last] > '0' && last > 0)
+		{
+			below[last]--;
+			CheckBoth(below + "9999" + exponent);
+		}
+	}
+
+	// Random values in the shapes exporters print.
+	char token[64];
+	for (int i = 0; i < 200000; i++)
+	{
+		double value = std::ldexp((double)(rng() >> 11), (int)(rng() % 200) - 150);
+		if (rng() % 2) value = -value;
+		static const char* const formats[] = { "%.6f", "%.9g", "%.17g", "%.3e", "%.20f" };
+		snprintf(token, sizeof(token), formats[i % 5], value);
+		CheckBoth(token);
+	}
+
+	// Nothing to parse.
+	static const char* const invalid[] = { "", "-", "+", ".5", "e5", "abc", "-.e" };
+	for (const char* s : invalid)
+	{
+		std::string padded = std::string(s) + std::string(16, '\0');
+		float value = 7.0f;
+		if (ParseDecimal(padded.c_str(), padded.c_str() + strlen(s), padded.c_str() + padded.size(), &value) || value != 7.0f)
+		{
+			printf("\"%s\" parsed\n", s);
+			s_num_failed++;
+		}
+	}
+
+	if (s_num_failed > 0)
+	{
+		printf("%d failed\n", s_num_failed);
+		return 1;
+	}
+	printf("all passed\n");
+	return 0;
+}
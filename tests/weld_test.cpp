@@ -0,0 +1,124 @@
+#include <algorithm>
+#include <cstdio>
+#include <cstring>
+#include <random>
+#include <unordered_map>
+#include <vector>
+
+#include "crc64.h"
+#include "flat_index_map.h"
+#include "tiny_obj_loader.h"
+#include "sort_weld.h"
+
+// Checks that welding on the index triple gives the same vertices as main.cpp's earlier weld on
+// the crc64 of the attribute values, on random meshes whose records all have distinct values, so
+// that the two keys tell the same corners apart. Also checks SortWeld against FlatIndexMap.
+
+// How main.cpp welded before. Returns the number of vertices.
+static size_t WeldCrc64(const tinyobj::attrib_t& attrib, const std::vector<tinyobj::index_t>& indices, int* corner_vertices)
+{
+	struct Attributes
+	{
+		float pos[3];
+		float norm[3];
+		float color[3];
+		float uv[2];
+	};
+
+	std::unordered_map<uint64_t, size_t> ind_map;
+	size_t num_vertices = 0;
+	for (size_t i = 0; i < indices.size(); i++)
+	{
+		const tinyobj::index_t& index = indices[i];
+		Attributes att;
+		memset(&att, 0, sizeof(att));
+		memcpy(att.pos, &attrib.vertices[3 * (size_t)index.vertex_index], sizeof(att.pos));
+		if (attrib.normals.size() > 0)
+		{
+			memcpy(att.norm, &attrib.normals[3 * (size_t)index.normal_index], sizeof(att.norm));
+		}
+		if (attrib.texcoords.size() > 0)
+		{
+			att.uv[0] = attrib.texcoords[2 * (size_t)index.texcoord_index];
+			att.uv[1] = 1.0f - attrib.texcoords[2 * (size_t)index.texcoord_index + 1];
+		}
+
+		uint64_t hash = crc64(0, (const unsigned char*)&att, sizeof(Attributes));
+		auto iter = ind_map.find(hash);
+		if (iter == ind_map.end())
+		{
+			iter = ind_map.emplace(hash, num_vertices++).first;
+		}
+		corner_vertices[i] = (int)iter->second;
+	}
+	return num_vertices;
+}
+
+int main()
+{
+	std::mt19937 rng(1);
+	int num_failed = 0;
+	for (int trial = 0; trial < 200; trial++)
+	{
+		int num_v = 1 + (int)(rng() % 2000);
+		int num_vn = trial % 3 == 0 ? 0 : 1 + (int)(rng() % 2000);
+		int num_vt = trial % 4 == 0 ? 0 : 1 + (int)(rng() % 2000);
+		tinyobj::attrib_t attrib;
+		for (int i = 0; i < num_v * 3; i++) attrib.vertices.push_back((float)i);
+		for (int i = 0; i < num_vn * 3; i++) attrib.normals.push_back((float)i);
+		for (int i = 0; i < num_vt * 2; i++) attrib.texcoords.push_back((float)i);
+
+		// Corners mostly reuse recent triples, as the faces of a mesh do.
+		size_t num_faces = 1 + rng() % 5000;
+		std::vector<tinyobj::index_t> indices(num_faces * 3);
+		for (size_t c = 0; c < indices.size(); c++)
+		{
+			if (c > 0 && rng() % 3 != 0)
+			{
+				indices[c] = indices[c - 1 - rng() % std::min(c, (size_t)12)];
+				continue;
+			}
+			indices[c].vertex_index = (int)(rng() % num_v);
+			indices[c].normal_index = num_vn > 0 ? (int)(rng() % num_vn) : -1;
+			indices[c].texcoord_index = num_vt > 0 ? (int)(rng() % num_vt) : -1;
+		}
+
+		std::vector<int> crc64_corners(indices.size());
+		size_t crc64_count = WeldCrc64(attrib, indices, crc64_corners.data());
+
+		FlatIndexMap<tinyobj::index_t> index_map(num_faces);
+		std::vector<tinyobj::index_t> hash_vertices;
+		std::vector<int> hash_corners(indices.size());
+		for (size_t c = 0; c < indices.size(); c++)
+		{
+			bool inserted;
+			hash_corners[c] = index_map.Insert(indices[c], &inserted);
+			if (inserted) hash_vertices.push_back(indices[c]);
+		}
+		if (hash_vertices.size() != crc64_count || hash_corners != crc64_corners)
+		{
+			printf("trial %d: FlatIndexMap %d vertices, crc64 weld %d\n", trial, (int)hash_vertices.size(), (int)crc64_count);
+			num_failed++;
+		}
+
+		std::vector<int> faces(num_faces);
+		for (size_t f = 0; f < num_faces; f++) faces[f] = (int)f;
+		std::vector<tinyobj::index_t> sort_vertices;
+		std::vector<int> sort_corners(indices.size());
+		SortWeld(indices.data(), faces.data(), num_faces, &sort_vertices, sort_corners.data());
+		if (sort_vertices.size() != hash_vertices.size() || sort_corners != hash_corners ||
+			memcmp(sort_vertices.data(), hash_vertices.data(), hash_vertices.size() * sizeof(tinyobj::index_t)) != 0)
+		{
+			printf("trial %d: SortWeld %d vertices, FlatIndexMap %d\n", trial, (int)sort_vertices.size(), (int)hash_vertices.size());
+			num_failed++;
+		}
+	}
+
+	if (num_failed > 0)
+	{
+		printf("%d failed\n", num_failed);
+		return 1;
+	}
+	printf("all passed\n");
+	return 0;
+}